@@ -0,0 +1,387 @@
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "deck_codec/base32.h"
+#include "deck_codec/caching_codec.h"
+#include "deck_codec/codec.h"
+#include "deck_codec/deck_builder.h"
+#include "deck_codec/deck_index.h"
+#include "deck_codec/deck_stats.h"
+#include "deck_codec/varint.h"
+#include "harness.h"
+#include "read_cases.h"
+
+/// grants the benchmarks access to the grouping stage of the encoder
+class CodecBenchmarks {
+  public:
+   static size_t group_and_sort(
+      std::vector< CardIdCount > &cards, std::vector< std::pair< size_t, size_t > > &bounds)
+   {
+      DeckCodec::_group_cards(cards, bounds);
+      DeckCodec::_sort_groups(bounds);
+      return bounds.size();
+   }
+};
+
+namespace {
+
+struct Corpus {
+   std::string name;
+   std::vector< std::string > codes;
+   std::vector< std::vector< CardToken > > token_decks;
+   std::vector< std::vector< CardIdCount > > id_decks;
+   /// the base32-decoded byte streams of the codes
+   std::vector< std::string > byte_streams;
+   size_t n_code_bytes = 0;
+   size_t n_stream_bytes = 0;
+};
+
+Corpus make_corpus(std::string name, std::vector< std::vector< CardIdCount > > id_decks)
+{
+   Corpus corpus;
+   corpus.name = std::move(name);
+   corpus.id_decks = std::move(id_decks);
+   for(const auto &deck : corpus.id_decks) {
+      std::vector< CardToken > tokens;
+      for(const auto &[id, count] : deck) {
+         tokens.emplace_back(DeckCodec::card_code(id), count);
+      }
+      corpus.token_decks.push_back(std::move(tokens));
+      corpus.codes.push_back(DeckCodec::encode(deck));
+      corpus.byte_streams.push_back(base32::decode(corpus.codes.back()));
+      corpus.n_code_bytes += corpus.codes.back().size();
+      corpus.n_stream_bytes += corpus.byte_streams.back().size();
+   }
+   return corpus;
+}
+
+Corpus case_corpus(const std::string &path)
+{
+   std::vector< std::vector< CardIdCount > > decks;
+   for(const auto &[code, tokens] : read_case_file(path)) {
+      std::vector< CardIdCount > deck;
+      for(const auto &token : tokens) {
+         deck.emplace_back(DeckCodec::parse_card_id(token.code()), token.count());
+      }
+      decks.push_back(std::move(deck));
+   }
+   return make_corpus("cases", std::move(decks));
+}
+
+/// 64 random decks of n_cards distinct cards, mostly 1-3 copies with a few 4+ ones
+Corpus synthetic_corpus(size_t n_cards)
+{
+   std::mt19937 rng(static_cast< uint32_t >(n_cards));
+   std::bernoulli_distribution four_plus_dist(0.1);
+   std::vector< std::vector< CardIdCount > > decks(64);
+   for(auto &deck : decks) {
+      deck = random_deck(rng, n_cards, 3, 6, 300);
+      for(auto &card : deck) {
+         card.second += four_plus_dist(rng) ? 3 : 0;
+      }
+   }
+   return make_corpus("synthetic_" + std::to_string(n_cards), std::move(decks));
+}
+
+void add_corpus_benchmarks(std::vector< bench::Benchmark > &benchmarks, const Corpus &corpus)
+{
+   const size_t n = corpus.codes.size();
+   const Corpus *c = &corpus;
+
+   benchmarks.push_back(bench::make("base32/encode/" + c->name, n, c->n_stream_bytes, [c] {
+      size_t total = 0;
+      for(const auto &bytes : c->byte_streams) {
+         total += base32::encode(bytes).size();
+      }
+      return total;
+   }));
+   benchmarks.push_back(bench::make("base32/decode/" + c->name, n, c->n_code_bytes, [c] {
+      size_t total = 0;
+      for(const auto &code : c->codes) {
+         total += base32::decode(code).size();
+      }
+      return total;
+   }));
+   benchmarks.push_back(bench::make("grouping/group_and_sort/" + c->name, n, 0, [c] {
+      // the copy stands in for the bucketing of the encoder
+      thread_local std::vector< CardIdCount > cards;
+      thread_local std::vector< std::pair< size_t, size_t > > bounds;
+      size_t total = 0;
+      for(const auto &deck : c->id_decks) {
+         cards.assign(deck.begin(), deck.end());
+         total += CodecBenchmarks::group_and_sort(cards, bounds);
+      }
+      return total;
+   }));
+   benchmarks.push_back(bench::make("codec/encode_tokens/" + c->name, n, 0, [c] {
+      size_t total = 0;
+      for(const auto &deck : c->token_decks) {
+         total += DeckCodec::encode(deck).size();
+      }
+      return total;
+   }));
+   benchmarks.push_back(bench::make("codec/encode_ids/" + c->name, n, 0, [c] {
+      size_t total = 0;
+      for(const auto &deck : c->id_decks) {
+         total += DeckCodec::encode(deck).size();
+      }
+      return total;
+   }));
+   benchmarks.push_back(bench::make("codec/decode_tokens/" + c->name, n, c->n_code_bytes, [c] {
+      size_t total = 0;
+      for(const auto &code : c->codes) {
+         total += DeckCodec::decode< CardToken >(code).size();
+      }
+      return total;
+   }));
+   benchmarks.push_back(bench::make("codec/decode_ids/" + c->name, n, c->n_code_bytes, [c] {
+      size_t total = 0;
+      for(const auto &code : c->codes) {
+         total += DeckCodec::decode< CardIdCount >(code).size();
+      }
+      return total;
+   }));
+   benchmarks.push_back(bench::make("codec/decode_inline/" + c->name, n, c->n_code_bytes, [c] {
+      InlineDeck< 256 > deck;
+      size_t total = 0;
+      for(const auto &code : c->codes) {
+         DeckCodec::decode(code, deck);
+         total += deck.size();
+      }
+      return total;
+   }));
+   benchmarks.push_back(bench::make("codec/arena_round_trip/" + c->name, n, c->n_code_bytes, [c] {
+      // a request handler's stack arena, released after every code
+      std::array< std::byte, 1 << 14 > buffer;
+      size_t total = 0;
+      for(const auto &code : c->codes) {
+         std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size());
+         auto deck = DeckCodec::decode< CardToken >(code, &arena);
+         total += DeckCodec::encode(deck, &arena).size();
+      }
+      return total;
+   }));
+   benchmarks.push_back(bench::make("codec/decode_batch_into/" + c->name, n, c->n_code_bytes, [c] {
+      thread_local DeckBatch batch;
+      batch.clear();
+      DeckCodec::decode_batch_into(c->codes, batch);
+      return batch.n_cards();
+   }));
+   benchmarks.push_back(bench::make("codec/canonicalize/" + c->name, n, c->n_code_bytes, [c] {
+      size_t total = 0;
+      for(const auto &code : c->codes) {
+         total += DeckCodec::canonicalize(code).size();
+      }
+      return total;
+   }));
+   benchmarks.push_back(bench::make("codec/fingerprint/" + c->name, n, c->n_code_bytes, [c] {
+      uint64_t total = 0;
+      for(const auto &code : c->codes) {
+         total += DeckCodec::fingerprint(code).value();
+      }
+      return total;
+   }));
+   benchmarks.push_back(bench::make("codec/diff/" + c->name, n, c->n_code_bytes, [c] {
+      // each deck against the next one of the corpus
+      size_t total = 0;
+      for(size_t i = 0; i < c->codes.size(); i++) {
+         total += DeckCodec::diff(c->codes[i], c->codes[(i + 1) % c->codes.size()]).size();
+      }
+      return total;
+   }));
+   benchmarks.push_back(bench::make("codec/diff_batch/" + c->name, n, c->n_code_bytes, [c] {
+      size_t total = 0;
+      for(const auto &item : DeckCodec::diff_batch(c->codes.front(), c->codes)) {
+         total += item.value.size();
+      }
+      return total;
+   }));
+   // one copy of the first card added and removed again per deck, the code read after each edit
+   auto builders = std::make_shared< std::vector< DeckBuilder > >();
+   for(const auto &code : c->codes) {
+      builders->push_back(DeckBuilder::from_code(code));
+   }
+   benchmarks.push_back(bench::make("builder/edit/" + c->name, 2 * n, 0, [c, builders] {
+      size_t total = 0;
+      for(size_t i = 0; i < builders->size(); i++) {
+         DeckBuilder &builder = (*builders)[i];
+         CardId id = c->id_decks[i].front().first;
+         builder.add(id);
+         total += builder.code().size();
+         builder.remove(id);
+         total += builder.code().size();
+      }
+      return total;
+   }));
+   benchmarks.push_back(bench::make("builder/edit_reencode/" + c->name, 2 * n, 0, [c] {
+      thread_local std::vector< CardIdCount > deck;
+      size_t total = 0;
+      for(const auto &ids : c->id_decks) {
+         deck.assign(ids.begin(), ids.end());
+         deck.front().second++;
+         total += DeckCodec::encode(deck).size();
+         deck.front().second--;
+         total += DeckCodec::encode(deck).size();
+      }
+      return total;
+   }));
+   benchmarks.push_back(bench::make("codec/cached_get/" + c->name, n, c->n_code_bytes, [c] {
+      // large enough for every corpus, so that all but the first round are hits
+      static CachingDeckCodec cache(1024);
+      size_t total = 0;
+      for(const auto &code : c->codes) {
+         total += cache.get(code)->size();
+      }
+      return total;
+   }));
+}
+
+void add_varint_benchmarks(std::vector< bench::Benchmark > &benchmarks)
+{
+   // card numbers, sets, region ids and counts: mostly one or two bytes
+   static std::vector< uint64_t > values;
+   static std::string stream;
+   std::mt19937 rng(1);
+   std::uniform_int_distribution< uint64_t > value_dist(0, 300);
+   for(size_t i = 0; i < 1024; i++) {
+      values.push_back(value_dist(rng));
+      std::array< char, Varint::MAX_BYTES > buffer;
+      stream.append(buffer.data(), Varint::write_varint(values.back(), buffer.data()));
+   }
+
+   benchmarks.push_back(bench::make("varint/from_int", values.size(), 0, [] {
+      size_t total = 0;
+      for(uint64_t value : values) {
+         total += Varint::from_int(value).size();
+      }
+      return total;
+   }));
+   benchmarks.push_back(bench::make("varint/write_varint", values.size(), 0, [] {
+      std::array< char, Varint::MAX_BYTES > buffer;
+      size_t total = 0;
+      for(uint64_t value : values) {
+         total += Varint::write_varint(value, buffer.data());
+         bench::do_not_optimize(buffer);
+      }
+      return total;
+   }));
+   benchmarks.push_back(bench::make("varint/write_varints", values.size(), 0, [] {
+      std::array< char, 1024 * Varint::MAX_BYTES > buffer;
+      char *end = Varint::write_varints(values.begin(), values.end(), buffer.data());
+      bench::do_not_optimize(buffer);
+      return static_cast< size_t >(end - buffer.data());
+   }));
+   benchmarks.push_back(bench::make("varint/pop_varint", values.size(), stream.size(), [] {
+      thread_local std::string bytes;
+      bytes = stream;
+      int64_t total = 0;
+      while(not bytes.empty()) {
+         total += Varint::pop_varint(bytes);
+      }
+      return total;
+   }));
+   benchmarks.push_back(bench::make("varint/read_varint", values.size(), stream.size(), [] {
+      const char *cursor = stream.data();
+      const char *end = stream.data() + stream.size();
+      uint64_t total = 0;
+      while(cursor != end) {
+         total += Varint::read_varint(cursor, end);
+      }
+      return total;
+   }));
+}
+
+void add_index_benchmarks(std::vector< bench::Benchmark > &benchmarks, const Corpus &corpus)
+{
+   // the decks of the corpus repeated into two full index containers
+   const size_t n = size_t(1) << 17U;
+   auto batch = std::make_shared< DeckBatch >();
+   for(size_t i = 0; i < n; i++) {
+      batch->push_back(corpus.id_decks[i % corpus.id_decks.size()]);
+   }
+   auto index = std::make_shared< DeckIndex >(DeckIndex::build(*batch));
+   const std::string name = corpus.name + "_x" + std::to_string(n);
+
+   // a card in 2+ copies, any card of its region and none of another region
+   CardId card = corpus.id_decks.front().front().first;
+   Region region = card.region();
+   Region excluded = region == Region::IONIA ? Region::NOXUS : Region::IONIA;
+   DeckQuery query =
+      DeckQuery::card(card, 2) & DeckQuery::region(region) & ~DeckQuery::region(excluded);
+
+   benchmarks.push_back(bench::make("index/build/" + name, n, 0, [batch] {
+      return DeckIndex::build(*batch).byte_size();
+   }));
+   benchmarks.push_back(bench::make("index/query/" + name, n, 0, [index, query] {
+      return index->count(query);
+   }));
+   auto scan = [batch, card, region, excluded] {
+      size_t total = 0;
+      for(size_t i = 0; i < batch->size(); i++) {
+         size_t count = 0;
+         bool has_region = false;
+         bool has_excluded = false;
+         for(const auto &[id, n_copies] : (*batch)[i]) {
+            count += id == card ? n_copies : 0;
+            has_region = has_region || id.region() == region;
+            has_excluded = has_excluded || id.region() == excluded;
+         }
+         total += count >= 2 && has_region && not has_excluded;
+      }
+      return total;
+   };
+   benchmarks.push_back(bench::make("index/linear_scan/" + name, n, 0, scan));
+}
+
+void add_stats_benchmarks(std::vector< bench::Benchmark > &benchmarks, const Corpus &corpus)
+{
+   const size_t n = size_t(1) << 16U;
+   auto codes = std::make_shared< std::vector< std::string > >();
+   auto batch = std::make_shared< DeckBatch >();
+   for(size_t i = 0; i < n; i++) {
+      codes->push_back(corpus.codes[i % corpus.codes.size()]);
+      batch->push_back(corpus.id_decks[i % corpus.id_decks.size()]);
+   }
+   const std::string name = corpus.name + "_x" + std::to_string(n);
+
+   benchmarks.push_back(bench::make("stats/add_codes/" + name, n, 0, [codes] {
+      DeckStats stats;
+      stats.add_codes(*codes);
+      return stats.n_pairs();
+   }));
+   benchmarks.push_back(bench::make("stats/add_decks/" + name, n, 0, [batch] {
+      DeckStats stats;
+      stats.add_decks(*batch);
+      return stats.n_pairs();
+   }));
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+   bench::Options opts = bench::parse_options(argc, argv);
+
+   std::vector< Corpus > corpora;
+   corpora.push_back(case_corpus(DECK_CODEC_TEST_CASES));
+   for(size_t n_cards : {1, 10, 40, 100, 200}) {
+      corpora.push_back(synthetic_corpus(n_cards));
+   }
+
+   std::vector< bench::Benchmark > benchmarks;
+   add_varint_benchmarks(benchmarks);
+   for(const auto &corpus : corpora) {
+      add_corpus_benchmarks(benchmarks, corpus);
+   }
+   add_index_benchmarks(benchmarks, corpora.front());
+   add_stats_benchmarks(benchmarks, corpora.front());
+   return bench::run_all(benchmarks, opts);
+}
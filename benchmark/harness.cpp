@@ -0,0 +1,348 @@
+
+#include "harness.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string_view>
+
+namespace {
+
+std::atomic< uint64_t > g_allocations{0};
+
+void *counted_alloc(std::size_t size)
+{
+   g_allocations.fetch_add(1, std::memory_order_relaxed);
+   return std::malloc(size == 0 ? 1 : size);
+}
+
+void *counted_aligned_alloc(std::size_t size, std::align_val_t align)
+{
+   g_allocations.fetch_add(1, std::memory_order_relaxed);
+   auto alignment = static_cast< std::size_t >(align);
+   // aligned_alloc takes only sizes that are a multiple of the alignment
+   std::size_t rounded = (std::max(size, std::size_t(1)) + alignment - 1) / alignment * alignment;
+#ifdef _MSC_VER
+   return _aligned_malloc(rounded, alignment);
+#else
+   return std::aligned_alloc(alignment, rounded);
+#endif
+}
+
+void aligned_free(void *ptr)
+{
+#ifdef _MSC_VER
+   _aligned_free(ptr);
+#else
+   std::free(ptr);
+#endif
+}
+
+void *throwing(void *ptr)
+{
+   if(ptr == nullptr) {
+      throw std::bad_alloc();
+   }
+   return ptr;
+}
+
+}  // namespace
+
+// count every heap allocation of the process, in all forms of operator new, to report allocations
+// per deck
+void *operator new(std::size_t size)
+{
+   return throwing(counted_alloc(size));
+}
+void *operator new[](std::size_t size)
+{
+   return throwing(counted_alloc(size));
+}
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+   return counted_alloc(size);
+}
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+   return counted_alloc(size);
+}
+void *operator new(std::size_t size, std::align_val_t align)
+{
+   return throwing(counted_aligned_alloc(size, align));
+}
+void *operator new[](std::size_t size, std::align_val_t align)
+{
+   return throwing(counted_aligned_alloc(size, align));
+}
+void *operator new(std::size_t size, std::align_val_t align, const std::nothrow_t &) noexcept
+{
+   return counted_aligned_alloc(size, align);
+}
+void *operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t &) noexcept
+{
+   return counted_aligned_alloc(size, align);
+}
+
+void operator delete(void *ptr) noexcept
+{
+   std::free(ptr);
+}
+void operator delete[](void *ptr) noexcept
+{
+   std::free(ptr);
+}
+void operator delete(void *ptr, std::size_t) noexcept
+{
+   std::free(ptr);
+}
+void operator delete[](void *ptr, std::size_t) noexcept
+{
+   std::free(ptr);
+}
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+   std::free(ptr);
+}
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+   std::free(ptr);
+}
+void operator delete(void *ptr, std::align_val_t) noexcept
+{
+   aligned_free(ptr);
+}
+void operator delete[](void *ptr, std::align_val_t) noexcept
+{
+   aligned_free(ptr);
+}
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept
+{
+   aligned_free(ptr);
+}
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept
+{
+   aligned_free(ptr);
+}
+void operator delete(void *ptr, std::align_val_t, const std::nothrow_t &) noexcept
+{
+   aligned_free(ptr);
+}
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept
+{
+   aligned_free(ptr);
+}
+
+namespace bench {
+
+uint64_t allocation_count()
+{
+   return g_allocations.load(std::memory_order_relaxed);
+}
+
+namespace {
+
+Result measure(const Benchmark &benchmark, double min_time_s)
+{
+   using clock = std::chrono::steady_clock;
+   size_t iterations = 1;
+   while(true) {
+      uint64_t allocs_before = allocation_count();
+      auto start = clock::now();
+      benchmark.run(iterations);
+      double elapsed = std::chrono::duration< double >(clock::now() - start).count();
+      uint64_t allocs = allocation_count() - allocs_before;
+
+      if(elapsed >= min_time_s || iterations >= (size_t(1) << 40)) {
+         Result result;
+         result.name = benchmark.name;
+         result.iterations = iterations;
+         result.ns_per_op = elapsed * 1e9 / static_cast< double >(iterations);
+         result.ns_per_item = result.ns_per_op / static_cast< double >(benchmark.items_per_op);
+         result.bytes_per_second = static_cast< double >(benchmark.bytes_per_op)
+                                   * static_cast< double >(iterations) / elapsed;
+         result.allocs_per_item =
+            static_cast< double >(allocs)
+            / (static_cast< double >(iterations) * static_cast< double >(benchmark.items_per_op));
+         return result;
+      }
+      // aim a bit past the minimum time, but grow at most 100-fold per round
+      double factor = elapsed > 0 ? min_time_s * 1.4 / elapsed : 100;
+      iterations = static_cast< size_t >(
+         static_cast< double >(iterations) * std::clamp(factor, 2.0, 100.0));
+   }
+}
+
+void save(const std::vector< Result > &results, const std::string &path)
+{
+   std::ofstream out(path);
+   out << "{\n  \"benchmarks\": [\n";
+   for(size_t i = 0; i < results.size(); i++) {
+      const auto &r = results[i];
+      out << "    {\"name\": \"" << r.name << "\", \"iterations\": " << r.iterations
+          << ", \"ns_per_op\": " << r.ns_per_op << ", \"ns_per_item\": " << r.ns_per_item
+          << ", \"bytes_per_second\": " << r.bytes_per_second
+          << ", \"allocs_per_item\": " << r.allocs_per_item << "}"
+          << (i + 1 < results.size() ? ",\n" : "\n");
+   }
+   out << "  ]\n}\n";
+   if(not out) {
+      std::fprintf(stderr, "cannot write the baseline %s\n", path.c_str());
+   }
+}
+
+/// reads the ns_per_op of every benchmark from a baseline written by save, empty if unreadable
+std::map< std::string, double > load(const std::string &path)
+{
+   std::ifstream in(path);
+   if(not in) {
+      return {};
+   }
+   std::stringstream buffer;
+   buffer << in.rdbuf();
+   std::string json = buffer.str();
+
+   std::map< std::string, double > baseline;
+   const std::string name_key = "\"name\": \"";
+   const std::string time_key = "\"ns_per_op\": ";
+   for(size_t pos = json.find(name_key); pos != std::string::npos;
+       pos = json.find(name_key, pos)) {
+      pos += name_key.size();
+      size_t name_end = json.find('"', pos);
+      size_t time_pos = json.find(time_key, name_end);
+      if(name_end == std::string::npos || time_pos == std::string::npos) {
+         break;
+      }
+      baseline[json.substr(pos, name_end - pos)] =
+         std::strtod(json.c_str() + time_pos + time_key.size(), nullptr);
+   }
+   return baseline;
+}
+
+void print_usage()
+{
+   std::fputs(
+      "usage: deck_benchmarks [--filter SUBSTRING] [--min-time SECONDS] [--save FILE]\n"
+      "                       [--compare FILE] [--threshold FRACTION]\n"
+      "  --filter     run only the benchmarks whose name contains SUBSTRING\n"
+      "  --min-time   minimum measuring time per benchmark, default 0.2\n"
+      "  --save       write the results as baseline JSON\n"
+      "  --compare    compare the results against a baseline JSON, exit code 1 on regressions,\n"
+      "               on baseline benchmarks that did not run and on an unreadable baseline\n"
+      "  --threshold  relative slowdown counted as regression, default 0.1\n",
+      stderr);
+}
+
+}  // namespace
+
+Options parse_options(int argc, char **argv)
+{
+   Options opts;
+   for(int i = 1; i < argc; i++) {
+      std::string_view arg = argv[i];
+      if(arg == "--help") {
+         print_usage();
+         std::exit(0);
+      }
+      bool takes_value = arg == "--filter" || arg == "--min-time" || arg == "--save"
+                         || arg == "--compare" || arg == "--threshold";
+      if(not takes_value) {
+         std::fprintf(stderr, "unknown option %s\n", argv[i]);
+         print_usage();
+         std::exit(1);
+      }
+      if(i + 1 >= argc) {
+         std::fprintf(stderr, "missing value for %s\n", argv[i]);
+         print_usage();
+         std::exit(1);
+      }
+      if(arg == "--filter") {
+         opts.filter = argv[++i];
+      } else if(arg == "--min-time") {
+         opts.min_time_s = std::strtod(argv[++i], nullptr);
+      } else if(arg == "--save") {
+         opts.save_path = argv[++i];
+      } else if(arg == "--compare") {
+         opts.compare_path = argv[++i];
+      } else {
+         opts.threshold = std::strtod(argv[++i], nullptr);
+      }
+   }
+   return opts;
+}
+
+int run_all(const std::vector< Benchmark > &benchmarks, const Options &opts)
+{
+   std::map< std::string, double > baseline;
+   if(not opts.compare_path.empty()) {
+      baseline = load(opts.compare_path);
+      // a gate without a baseline would pass any result
+      if(baseline.empty()) {
+         std::fprintf(stderr, "cannot read a baseline from %s\n", opts.compare_path.c_str());
+         return 1;
+      }
+   }
+
+   std::printf(
+      "%-44s %12s %12s %12s %11s%s\n",
+      "benchmark",
+      "ns/op",
+      "ns/deck",
+      "MB/s",
+      "allocs/deck",
+      baseline.empty() ? "" : "   vs baseline");
+   std::vector< Result > results;
+   size_t n_regressions = 0;
+   for(const auto &benchmark : benchmarks) {
+      if(benchmark.name.find(opts.filter) == std::string::npos) {
+         continue;
+      }
+      Result r = measure(benchmark, opts.min_time_s);
+      std::printf(
+         "%-44s %12.1f %12.1f %12.1f %11.3f",
+         r.name.c_str(),
+         r.ns_per_op,
+         r.ns_per_item,
+         r.bytes_per_second / 1e6,
+         r.allocs_per_item);
+      if(auto it = baseline.find(r.name); it != baseline.end() && it->second > 0) {
+         double change = r.ns_per_op / it->second - 1;
+         bool regressed = change > opts.threshold;
+         n_regressions += regressed;
+         std::printf("   %+7.1f%%%s", change * 100, regressed ? "  REGRESSION" : "");
+      }
+      std::printf("\n");
+      std::fflush(stdout);
+      results.push_back(r);
+   }
+   if(not opts.save_path.empty()) {
+      save(results, opts.save_path);
+   }
+
+   // the baseline benchmarks selected by the filter that no longer exist
+   size_t n_missing = 0;
+   for(const auto &entry : baseline) {
+      const std::string &name = entry.first;
+      bool ran = std::any_of(
+         results.begin(), results.end(), [&name](const Result &r) { return r.name == name; });
+      if(name.find(opts.filter) != std::string::npos && not ran) {
+         std::printf("%-44s missing, in the baseline only\n", name.c_str());
+         n_missing++;
+      }
+   }
+   if(n_regressions > 0) {
+      std::printf(
+         "%zu benchmarks regressed by more than %.0f%%\n", n_regressions, opts.threshold * 100);
+   }
+   if(n_missing > 0) {
+      std::printf("%zu benchmarks of the baseline did not run\n", n_missing);
+   }
+   return n_regressions > 0 || n_missing > 0 ? 1 : 0;
+}
+
+}  // namespace bench
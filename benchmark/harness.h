@@ -0,0 +1,86 @@
+
+#ifndef LORDECKENCODER_BENCHMARK_HARNESS_H
+#define LORDECKENCODER_BENCHMARK_HARNESS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+/// keeps the compiler from optimizing away the computation of the value
+template < typename T >
+inline void do_not_optimize(const T &value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+   asm volatile("" : : "r,m"(value) : "memory");
+#else
+   static volatile const void *sink;
+   sink = &value;
+#endif
+}
+
+struct Benchmark {
+   std::string name;
+   /// the number of decks (or other items) one operation processes
+   size_t items_per_op = 1;
+   /// the number of input bytes one operation processes, 0 if not meaningful
+   size_t bytes_per_op = 0;
+   /// runs the operation the given number of times
+   std::function< void(size_t) > run;
+};
+
+/**
+ * Registers a benchmark whose operation is the given callable. The result of each call is kept
+ * alive with do_not_optimize.
+ */
+template < typename Op >
+Benchmark make(std::string name, size_t items_per_op, size_t bytes_per_op, Op op)
+{
+   return {std::move(name), items_per_op, bytes_per_op, [op](size_t n_iterations) mutable {
+              for(size_t i = 0; i < n_iterations; i++) {
+                 do_not_optimize(op());
+              }
+           }};
+}
+
+struct Result {
+   std::string name;
+   size_t iterations = 0;
+   double ns_per_op = 0;
+   double ns_per_item = 0;
+   double bytes_per_second = 0;
+   /// the heap allocations per deck (or other item), like ns_per_item
+   double allocs_per_item = 0;
+};
+
+struct Options {
+   /// only benchmarks whose name contains the filter run
+   std::string filter;
+   double min_time_s = 0.2;
+   /// the file to save the results to as baseline JSON
+   std::string save_path;
+   /// the baseline JSON to compare the results against
+   std::string compare_path;
+   /// the relative slowdown reported as regression
+   double threshold = 0.1;
+};
+
+/// the number of heap allocations made by the process so far
+uint64_t allocation_count();
+
+/**
+ * Runs the benchmarks, prints a table of the results and saves or compares them as requested.
+ * @return int,
+ *      the exit code: 1 if a comparison found regressions, 0 otherwise
+ */
+int run_all(const std::vector< Benchmark > &benchmarks, const Options &opts);
+
+/// parses the command line options, prints the usage and exits on bad input
+Options parse_options(int argc, char **argv);
+
+}  // namespace bench
+
+#endif  // LORDECKENCODER_BENCHMARK_HARNESS_H
@@ -2,16 +2,17 @@
 #ifndef LORDECKENCODER_BASE32_H
 #define LORDECKENCODER_BASE32_H
 
+#include <algorithm>
+#include <array>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
-#include <map>
-#include <regex>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 
-#include "string_utils.h"
-
 template < size_t v, uint32_t i, uint32_t n >
 constexpr static std::array< uint32_t, 2 > move_bits()
 {
@@ -35,12 +36,127 @@ constexpr static uint32_t nr_trailing_zeros()
    return d[1] - static_cast< int32_t >((static_cast< uint32_t >(d[0] << 1) >> 31));
 }
 
+/// markers of the base32 decode table for characters that carry no 5-bit value
+enum Base32Symbol : uint8_t { B32_INVALID = 0xFF, B32_SEPARATOR = 0xFE, B32_PADDING = 0xFD };
+
+/**
+ * Builds the lookup table mapping every byte to its 5-bit value in the alphabet (case-insensitive),
+ * or to one of the Base32Symbol markers.
+ */
+constexpr static std::array< uint8_t, 256 > build_decode_table(
+   const char *alphabet, char separator, char padding)
+{
+   std::array< uint8_t, 256 > table{};
+   for(auto &entry : table) {
+      entry = B32_INVALID;
+   }
+   for(uint8_t value = 0; alphabet[value] != '\0'; value++) {
+      auto c = static_cast< uint8_t >(alphabet[value]);
+      table[c] = value;
+      if(c >= 'A' && c <= 'Z') {
+         table[c | 0x20U] = value;
+      }
+   }
+   table[static_cast< uint8_t >(separator)] = B32_SEPARATOR;
+   table[static_cast< uint8_t >(padding)] = B32_PADDING;
+   return table;
+}
+
 class base32 {
   public:
    using byte = int8_t;
 
-   static std::string decode(std::string code);
-   static std::string encode(const std::string &text, bool pad_output = false);
+   /// the implementations of the vectorized block kernels behind decode and encode
+   enum class Kernel { SCALAR = 0, SSE41, AVX2 };
+
+   /**
+    * Decode the base32 code. Surrounding whitespace is ignored, '-' separators are skipped, upper
+    * and lower case are accepted and trailing '=' padding is dropped, all in one pass.
+    * @param code std::string_view,
+    *      the code to decode
+    * @param strict bool,
+    *      whether to reject codes whose final character carries non-zero bits that do not make up
+    *      a full byte, or which hold a character more than needed for the decoded bytes. By
+    *      default these leftover bits are ignored.
+    * @return std::string,
+    *      the decoded bytes. Throws std::invalid_argument on illegal characters.
+    */
+   static std::string decode(std::string_view code, bool strict = false);
+   /**
+    * Decode the base32 code like decode(), but into caller memory.
+    * @param out char*,
+    *      the output, which has to hold decoded_capacity(code.size()) bytes
+    * @return size_t,
+    *      the number of decoded bytes
+    */
+   static size_t decode_to(std::string_view code, char *out, bool strict = false);
+   /**
+    * Decode the base32 code like decode(), but without the vector kernels so that it can run in
+    * constant expressions.
+    * @param code std::string_view,
+    *      the code to decode
+    * @param out char*,
+    *      the output, which has to hold decoded_capacity(code.size()) bytes
+    * @param strict bool,
+    *      whether to reject non-zero leftover bits, see decode()
+    * @return size_t,
+    *      the number of decoded bytes
+    */
+   static constexpr size_t decode_ct(std::string_view code, char *out, bool strict = false);
+   static std::string encode(std::string_view text, bool pad_output = false);
+   /**
+    * Encode the bytes as base32 straight into the output iterator.
+    * @param text std::string_view,
+    *      the bytes to encode
+    * @param out OutputIt,
+    *      the iterator to write the characters to
+    * @param pad_output bool,
+    *      whether to pad the output with '=' to a multiple of 8 characters
+    * @return OutputIt,
+    *      the iterator past the last written character
+    */
+   template < typename OutputIt >
+   static OutputIt encode_to(std::string_view text, OutputIt out, bool pad_output = false);
+   /**
+    * Encode the bytes as base32 into the caller supplied buffer. Throws std::length_error if the
+    * buffer cannot hold encoded_size(text.size(), pad_output) characters.
+    * @return size_t,
+    *      the number of characters written
+    */
+   static size_t encode_to(
+      std::string_view text, char *out, size_t capacity, bool pad_output = false);
+   /**
+    * Encode the bytes like encode_to(), but without the vector kernels so that it can run in
+    * constant expressions. The output has to hold encoded_size(text.size(), pad_output) characters.
+    * @return size_t,
+    *      the number of characters written
+    */
+   static constexpr size_t encode_ct(std::string_view text, char *out, bool pad_output = false);
+   /**
+    * The fastest kernel supported by the running CPU, determined via CPUID.
+    */
+   static Kernel best_kernel();
+   /**
+    * Overrides the kernel used from now on, e.g. to compare kernels in tests and benchmarks. A
+    * kernel the CPU does not support is replaced by the best supported one.
+    */
+   static void use_kernel(Kernel kernel);
+   /**
+    * The kernel currently in use. Defaults to best_kernel().
+    */
+   static Kernel kernel();
+   /**
+    * The number of characters the base32 encoding of n_bytes bytes takes.
+    */
+   static constexpr size_t encoded_size(size_t n_bytes, bool pad_output = false)
+   {
+      size_t n_chars = (n_bytes * 8 + SHIFT - 1) / SHIFT;
+      return pad_output ? (n_chars + 7) / 8 * 8 : n_chars;
+   }
+   /**
+    * An upper bound on the number of bytes a code of n_chars characters decodes to.
+    */
+   static constexpr size_t decoded_capacity(size_t n_chars) { return n_chars * SHIFT / 8; }
 
   private:
    constexpr static const char *DIGITS = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
@@ -48,10 +164,199 @@ class base32 {
    constexpr static const size_t MASK = len - 1;
    constexpr static uint32_t SHIFT = nr_trailing_zeros< len >();
    constexpr static const char *SEPARATOR = "-";
-   static std::map< char, int > _build_char_map();
-
-   static const std::map< char, int > CHAR_MAP;
+   constexpr static char PADDING = '=';
+   constexpr static std::array< uint8_t, 256 > DECODE_TABLE = build_decode_table(
+      DIGITS, *SEPARATOR, PADDING);
    static int32_t _nr_trailing_zeros(int32_t i);
+
+   /// the progress of decoding a code character by character
+   struct DecodeState {
+      uint32_t buffer = 0;
+      uint32_t bits_left = 0;
+      bool in_padding = false;
+      /// the number of bytes written
+      size_t next = 0;
+   };
+   /// removes surrounding whitespace
+   static constexpr std::string_view _trim(std::string_view code);
+   /**
+    * Decodes the characters [pos, stop) of the code one by one, skipping separators and padding.
+    * @return size_t,
+    *      the position after the last decoded character, i.e. stop
+    */
+   static constexpr size_t _decode_scalar(
+      std::string_view code, size_t pos, size_t stop, DecodeState &state, char *out);
+   /// rejects non-zero leftover bits or a surplus character if asked to be strict
+   static constexpr void _check_leftover(const DecodeState &state, bool strict);
+   /**
+    * Decodes the leading complete blocks of 8 characters with the active vector kernel.
+    * Stops before the first block holding a character outside the alphabet.
+    * @param code const char*,
+    *      the characters to decode
+    * @param n_chars size_t,
+    *      the number of characters
+    * @param out char*,
+    *      the output receiving 5 bytes per decoded block
+    * @return size_t,
+    *      the number of characters decoded, a multiple of 8
+    */
+   static size_t _decode_blocks(const char *code, size_t n_chars, char *out);
+   /**
+    * Encodes leading complete blocks of 5 bytes with the active vector kernel.
+    * @param text const char*,
+    *      the bytes to encode
+    * @param n_bytes size_t,
+    *      the number of bytes
+    * @param out char*,
+    *      the output receiving 8 characters per encoded block
+    * @return size_t,
+    *      the number of bytes encoded, a multiple of 5
+    */
+   static size_t _encode_blocks(const char *text, size_t n_bytes, char *out);
+   /// encodes the bytes one by one, the final character is filled up with zero bits
+   template < typename OutputIt >
+   static constexpr OutputIt _encode_scalar(std::string_view text, OutputIt out);
+   /// appends '=' up to a multiple of 8 characters if padding is requested
+   template < typename OutputIt >
+   static constexpr OutputIt _pad(OutputIt out, size_t n_written, bool pad_output);
 };
 
+template < typename OutputIt >
+OutputIt base32::encode_to(std::string_view text, OutputIt out, bool pad_output)
+{
+   if(text.empty()) {
+      return out;
+   }
+
+   // SHIFT is the number of bits per output character, so the length of the
+   // output is the length of the input multiplied by 8/SHIFT, rounded up.
+   if(text.size() >= (1 << 28)) {
+      // The computation below will fail, so don't do it.
+      throw std::out_of_range("text");
+   }
+
+   size_t n_written = 0;
+   // whole blocks of 5 bytes are turned into 8 characters by the vector kernel, either straight
+   // into the output or through a small chunk buffer
+   if constexpr(std::is_same_v< OutputIt, char * >) {
+      size_t n_encoded = _encode_blocks(text.data(), text.size(), out);
+      n_written = n_encoded / 5 * 8;
+      out += n_written;
+      text.remove_prefix(n_encoded);
+   } else {
+      std::array< char, 256 > chunk;
+      while(size_t n_encoded = _encode_blocks(
+               text.data(), std::min(text.size(), chunk.size() / 8 * 5), chunk.data())) {
+         out = std::copy_n(chunk.data(), n_encoded / 5 * 8, out);
+         n_written += n_encoded / 5 * 8;
+         text.remove_prefix(n_encoded);
+      }
+   }
+   out = _encode_scalar(text, out);
+   return _pad(out, n_written + encoded_size(text.size()), pad_output);
+}
+
+template < typename OutputIt >
+constexpr OutputIt base32::_encode_scalar(std::string_view text, OutputIt out)
+{
+   constexpr uint32_t byte_len = 8;
+   if(text.empty()) {
+      return out;
+   }
+   // only the lowest bits of the buffer are ever read, so it may overflow freely
+   uint32_t buffer = static_cast< uint8_t >(text[0]);
+   size_t next = 1;
+   uint32_t bits_left = byte_len;
+   while(bits_left > 0 || next < text.size()) {
+      if(bits_left < SHIFT) {
+         if(next < text.size()) {
+            buffer <<= 8;
+            buffer |= static_cast< uint8_t >(text[next++]);
+            bits_left += 8;
+         } else {
+            uint32_t pad = SHIFT - bits_left;
+            buffer <<= pad;
+            bits_left += pad;
+         }
+      }
+      *out++ = DIGITS[MASK & (buffer >> (bits_left - SHIFT))];
+      bits_left -= SHIFT;
+   }
+   return out;
+}
+
+template < typename OutputIt >
+constexpr OutputIt base32::_pad(OutputIt out, size_t n_written, bool pad_output)
+{
+   if(pad_output) {
+      for(; n_written % 8 != 0; n_written++) {
+         *out++ = '=';
+      }
+   }
+   return out;
+}
+
+constexpr size_t base32::encode_ct(std::string_view text, char *out, bool pad_output)
+{
+   return static_cast< size_t >(
+      _pad(_encode_scalar(text, out), encoded_size(text.size()), pad_output) - out);
+}
+
+constexpr size_t base32::decode_ct(std::string_view code, char *out, bool strict)
+{
+   code = _trim(code);
+   DecodeState state;
+   _decode_scalar(code, 0, code.size(), state, out);
+   _check_leftover(state, strict);
+   return state.next;
+}
+
+constexpr std::string_view base32::_trim(std::string_view code)
+{
+   auto is_space = [](char c) {
+      return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+   };
+   while(not code.empty() && is_space(code.front())) {
+      code.remove_prefix(1);
+   }
+   while(not code.empty() && is_space(code.back())) {
+      code.remove_suffix(1);
+   }
+   return code;
+}
+
+constexpr size_t base32::_decode_scalar(
+   std::string_view code, size_t pos, size_t stop, DecodeState &state, char *out)
+{
+   for(; pos < stop; pos++) {
+      char c = code[pos];
+      uint8_t value = DECODE_TABLE[static_cast< uint8_t >(c)];
+      if(value < len && not state.in_padding) {
+         state.buffer <<= SHIFT;
+         state.buffer |= value;
+         state.bits_left += SHIFT;
+         if(state.bits_left >= 8) {
+            out[state.next++] = static_cast< char >(state.buffer >> (state.bits_left - 8));
+            state.bits_left -= 8;
+         }
+      } else if(value == B32_PADDING) {
+         // Note: the padding could be used as hint to determine how many bits to decode from the
+         // last incomplete chunk, but all that follows it has to be padding as well.
+         state.in_padding = true;
+      } else if(value != B32_SEPARATOR || state.in_padding) {
+         throw std::invalid_argument(std::string("Illegal character: ") + c);
+      }
+   }
+   return pos;
+}
+
+constexpr void base32::_check_leftover(const DecodeState &state, bool strict)
+{
+   // Leftover bits are ignored unless asked to be strict.
+   if(strict
+      && (state.bits_left >= SHIFT || (state.buffer & ((1U << state.bits_left) - 1)) != 0)) {
+      throw std::invalid_argument("Bits left: " + std::to_string(state.bits_left));
+   }
+}
+
 #endif  // LORDECKENCODER_BASE32_H
@@ -0,0 +1,19 @@
+
+#ifndef LORDECKENCODER_BATCH_ITEM_H
+#define LORDECKENCODER_BATCH_ITEM_H
+
+#include <string>
+
+/**
+ * The outcome of one item of a batch operation. Failing items do not abort the batch, instead
+ * their error message is stored alongside the (then empty) value.
+ */
+template < typename T >
+struct BatchItem {
+   T value{};
+   std::string error;
+
+   [[nodiscard]] bool ok() const { return error.empty(); }
+};
+
+#endif  // LORDECKENCODER_BATCH_ITEM_H
@@ -0,0 +1,189 @@
+
+#ifndef LORDECKENCODER_CACHING_CODEC_H
+#define LORDECKENCODER_CACHING_CODEC_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "card_id.h"
+#include "codec.h"
+
+/**
+ * An immutable decoded deck in compact form: every card is packed into a single 64-bit word holding
+ * the CardId value in the upper and the count in the lower half. Iterating it yields CardIdCount
+ * values, which makes it a valid deck container for DeckCodec.
+ */
+class PackedDeck {
+  public:
+   using value_type = CardIdCount;
+
+   class const_iterator {
+     public:
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = CardIdCount;
+      using difference_type = std::ptrdiff_t;
+      using pointer = void;
+      using reference = CardIdCount;
+
+      explicit const_iterator(const uint64_t *card) : m_card(card) {}
+      CardIdCount operator*() const { return PackedDeck::_unpack(*m_card); }
+      const_iterator &operator++()
+      {
+         m_card++;
+         return *this;
+      }
+      const_iterator operator++(int)
+      {
+         const_iterator prev = *this;
+         m_card++;
+         return prev;
+      }
+      bool operator==(const const_iterator &other) const { return m_card == other.m_card; }
+      bool operator!=(const const_iterator &other) const { return m_card != other.m_card; }
+
+     private:
+      const uint64_t *m_card;
+   };
+
+   PackedDeck() = default;
+   /// packs the cards, throws std::invalid_argument if a count does not fit into 32 bits
+   explicit PackedDeck(const std::vector< CardIdCount > &cards);
+
+   [[nodiscard]] size_t size() const { return m_cards.size(); }
+   [[nodiscard]] bool empty() const { return m_cards.empty(); }
+   [[nodiscard]] CardIdCount operator[](size_t idx) const { return _unpack(m_cards[idx]); }
+   [[nodiscard]] const_iterator begin() const { return const_iterator(m_cards.data()); }
+   [[nodiscard]] const_iterator end() const
+   {
+      return const_iterator(m_cards.data() + m_cards.size());
+   }
+   /// the heap memory held by the deck
+   [[nodiscard]] size_t byte_size() const { return m_cards.capacity() * sizeof(uint64_t); }
+
+  private:
+   static CardIdCount _unpack(uint64_t card)
+   {
+      return {CardId::from_value(static_cast< uint32_t >(card >> 32U)), card & 0xFFFFFFFFU};
+   }
+
+   std::vector< uint64_t > m_cards;
+};
+
+/**
+ * A concurrent cache in front of DeckCodec::decode for workloads in which a few codes make up most
+ * of the traffic. Codes are normalized (whitespace, separators and trailing padding dropped, upper
+ * cased) before lookup, so that the spellings of a code share one entry.
+ *
+ * The entries are spread over independently locked shards by the hash of their code. Lookups only
+ * take a shared lock on their shard and hand out the cached deck as shared pointer, so repeated
+ * decodes neither allocate nor contend with each other. Each shard holds a fixed number of slots
+ * and evicts with the CLOCK algorithm: a hit marks its slot as referenced, and the eviction hand
+ * passes over referenced slots once before reusing them.
+ */
+class CachingDeckCodec {
+  public:
+   struct Stats {
+      uint64_t hits = 0;
+      uint64_t misses = 0;
+      uint64_t evictions = 0;
+      /// the number of cached decks
+      size_t size = 0;
+   };
+
+   /**
+    * @param capacity size_t,
+    *      the maximum number of cached decks, which bounds the memory taken by the cache
+    * @param n_shards size_t,
+    *      the number of independently locked shards, rounded up to a power of two and then
+    *      halved until every shard holds at least one slot. The capacity is split over the shards.
+    */
+   explicit CachingDeckCodec(size_t capacity = 1U << 14U, size_t n_shards = 16);
+
+   CachingDeckCodec(const CachingDeckCodec &) = delete;
+   CachingDeckCodec &operator=(const CachingDeckCodec &) = delete;
+
+   /**
+    * Looks the code up and decodes it on a miss.
+    * @param deck_code std::string_view,
+    *      the deck code to decode
+    * @return std::shared_ptr<const PackedDeck>,
+    *      the decoded deck, which stays valid after its eviction. Throws std::invalid_argument for
+    *      codes that cannot be decoded; these are not cached.
+    */
+   std::shared_ptr< const PackedDeck > get(std::string_view deck_code);
+   /**
+    * Decode the deck code like DeckCodec::decode, served from the cache.
+    * @return std::vector<CardCountType>,
+    *      the deck extracted from the code
+    */
+   template < typename CodeCountType >
+   std::vector< CodeCountType > decode(std::string_view deck_code);
+
+   /// the counters summed over all shards
+   [[nodiscard]] Stats stats() const;
+   /// drops all entries, the counters are kept
+   void clear();
+
+  private:
+   struct Slot {
+      std::string key;
+      uint64_t hash = 0;
+      std::shared_ptr< const PackedDeck > deck;
+      /// the CLOCK reference bit, set by hits under the shared lock
+      std::atomic< bool > referenced{false};
+   };
+   struct Shard {
+      mutable std::shared_mutex mutex;
+      /// from the code hash to the slots holding codes of that hash
+      std::unordered_multimap< uint64_t, size_t > index;
+      std::vector< Slot > slots;
+      size_t n_used = 0;
+      size_t hand = 0;
+      std::atomic< uint64_t > hits{0};
+      std::atomic< uint64_t > misses{0};
+      std::atomic< uint64_t > evictions{0};
+   };
+
+   /**
+    * Writes the normalized code into the buffer.
+    * @return std::string_view,
+    *      the normalized code, a view on the buffer
+    */
+   static std::string_view _normalize(std::string_view deck_code, std::string &buffer);
+   /// looks the normalized code up, returns an empty pointer on a miss
+   static std::shared_ptr< const PackedDeck > _find(
+      Shard &shard, std::string_view key, uint64_t hash);
+   /// inserts the deck unless another thread was first, and returns the cached deck
+   static std::shared_ptr< const PackedDeck > _insert(
+      Shard &shard, std::string_view key, uint64_t hash, std::shared_ptr< const PackedDeck > deck);
+
+   std::vector< std::unique_ptr< Shard > > m_shards;
+   size_t m_shard_mask;
+};
+
+template < typename CodeCountType >
+std::vector< CodeCountType > CachingDeckCodec::decode(std::string_view deck_code)
+{
+   auto deck = get(deck_code);
+   std::vector< CodeCountType > result;
+   result.reserve(deck->size());
+   for(const auto &[id, count] : *deck) {
+      if constexpr(std::is_constructible_v< CodeCountType, CardId, size_t >) {
+         result.emplace_back(id, count);
+      } else {
+         result.emplace_back(DeckCodec::card_code(id), count);
+      }
+   }
+   return result;
+}
+
+#endif  // LORDECKENCODER_CACHING_CODEC_H
@@ -0,0 +1,61 @@
+
+#ifndef LORDECKENCODER_CARD_ID_H
+#define LORDECKENCODER_CARD_ID_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "region.h"
+
+/**
+ * Packed card identifier. The three parts of a card code XXYYZZZ are held in a single 32-bit word:
+ *      bits 24-31 = the set number XX
+ *      bits 16-23 = the region YY (as underlying value of the Region enum)
+ *      bits  0-15 = the card number ZZZ
+ * The upper 16 bits thereby identify the set-faction group a card belongs to.
+ */
+class CardId {
+  public:
+   constexpr CardId() = default;
+   constexpr CardId(uint32_t set, Region region, uint32_t number)
+       : m_value(
+          ((set & 0xFFU) << 24U) | ((static_cast< uint32_t >(region) & 0xFFU) << 16U)
+          | (number & 0xFFFFU))
+   {
+   }
+
+   static constexpr CardId from_value(uint32_t value)
+   {
+      CardId id;
+      id.m_value = value;
+      return id;
+   }
+
+   [[nodiscard]] constexpr uint32_t set() const { return m_value >> 24U; }
+   [[nodiscard]] constexpr Region region() const
+   {
+      return static_cast< Region >((m_value >> 16U) & 0xFFU);
+   }
+   [[nodiscard]] constexpr uint32_t number() const { return m_value & 0xFFFFU; }
+   /// the set-faction part of the id, shared by all cards of one group
+   [[nodiscard]] constexpr uint32_t group() const { return m_value >> 16U; }
+   [[nodiscard]] constexpr uint32_t value() const { return m_value; }
+
+   constexpr bool operator==(const CardId &other) const { return m_value == other.m_value; }
+   constexpr bool operator!=(const CardId &other) const { return m_value != other.m_value; }
+   constexpr bool operator<(const CardId &other) const { return m_value < other.m_value; }
+
+   static constexpr uint32_t MAX_SET = 0xFF;
+   static constexpr uint32_t MAX_NUMBER = 0xFFFF;
+
+  private:
+   uint32_t m_value = 0;
+};
+
+/// The integer counterpart of a CardToken: a packed card id and its count.
+using CardIdCount = std::pair< CardId, size_t >;
+/// The change of a card's count between two decks, positive for copies added.
+using CardDelta = std::pair< CardId, int64_t >;
+
+#endif  // LORDECKENCODER_CARD_ID_H
@@ -3,16 +3,28 @@
 #define LORDECKENCODER_CODEC_H
 
 #include <algorithm>
+#include <array>
 #include <cstdint>
 #include <list>
-#include <map>
+#include <memory_resource>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
 #include "base32.h"
+#include "batch_item.h"
+#include "card_id.h"
 #include "card_token.h"
+#include "deck_batch.h"
+#include "fingerprint.h"
+#include "inline_deck.h"
 #include "region.h"
+#include "static_code.h"
+#include "thread_pool.h"
 #include "utils.h"
 #include "varint.h"
 
@@ -25,6 +37,8 @@ class DeckCodec {
     * The cards are first split into groups of cards with the same count.
     * Then they are further split in set-faction groups, sorted, and subsequently encoded. The full
     * byte stream is then encoded as base32.
+    * A container of CardIdCount pairs is encoded directly, any other card type is parsed into its
+    * packed CardId once before encoding.
     * @param deck std::vector<CardCountType>,
     *      the deck to encode
     * @return std::string,
@@ -32,15 +46,278 @@ class DeckCodec {
     */
    template < typename DeckContainer >
    static std::string encode(const DeckContainer &deck);
+   /**
+    * Encode the deck like encode(), but allocate the deck code from the memory resource. As the
+    * internal buffers are per-thread and reused, an encode with a request-scoped arena makes no
+    * global heap allocations once these buffers have warmed up.
+    * @param deck DeckContainer,
+    *      the deck to encode
+    * @param resource std::pmr::memory_resource*,
+    *      the resource to allocate the deck code from
+    * @return std::pmr::string,
+    *      the encoded deck code
+    */
+   template < typename DeckContainer >
+   static std::pmr::string encode(const DeckContainer &deck, std::pmr::memory_resource *resource);
+   /**
+    * Encode the deck straight into caller memory. Apart from warming up per-thread scratch buffers
+    * on first use, no heap allocations are made.
+    * @param deck DeckContainer,
+    *      the deck to encode
+    * @param out char*,
+    *      the buffer to write the deck code to (not null-terminated)
+    * @param capacity size_t,
+    *      the size of the buffer. max_encoded_size(deck) characters always suffice, otherwise
+    *      std::length_error is thrown if the code does not fit.
+    * @return size_t,
+    *      the number of characters written
+    */
+   template < typename DeckContainer >
+   static size_t encode_to(const DeckContainer &deck, char *out, size_t capacity);
+   /**
+    * Encode the deck straight into the output iterator.
+    * @param deck DeckContainer,
+    *      the deck to encode
+    * @param out OutputIt,
+    *      the iterator to write the characters of the deck code to
+    * @return OutputIt,
+    *      the iterator past the last written character
+    */
+   template < typename DeckContainer, typename OutputIt >
+   static OutputIt encode_to(const DeckContainer &deck, OutputIt out);
+   /**
+    * An upper bound on the number of characters the deck code of the given deck will take.
+    * @param deck DeckContainer,
+    *      the deck to encode
+    * @return size_t,
+    *      the maximum length of the deck code
+    */
+   template < typename DeckContainer >
+   static size_t max_encoded_size(const DeckContainer &deck);
    /**
     * Decode the deck code into a deck design object.
-    * @param deck_code std::string,
+    * If the requested type is constructible from (CardId, size_t), e.g. CardIdCount, the packed ids
+    * are handed over directly and no card code strings are built.
+    * @param deck_code std::string_view,
     *      the deck code to decode
     * @return std::vector<CardCountType>,
     *      the deck extracted from the code
     */
    template < typename CodeCountType >
-   static std::vector< CodeCountType > decode(const std::string &deck_code);
+   static std::vector< CodeCountType > decode(std::string_view deck_code);
+   /**
+    * Decode the deck code like decode(), but allocate the deck from the memory resource. Card codes
+    * of CardTokens fit the small string buffer, so that with a request-scoped arena no global heap
+    * allocations are made once the per-thread buffers have warmed up.
+    * @param deck_code std::string_view,
+    *      the deck code to decode
+    * @param resource std::pmr::memory_resource*,
+    *      the resource to allocate the deck from
+    * @return std::pmr::vector<CardCountType>,
+    *      the deck extracted from the code
+    */
+   template < typename CodeCountType >
+   static std::pmr::vector< CodeCountType > decode(
+      std::string_view deck_code, std::pmr::memory_resource *resource);
+   /**
+    * Decode the deck code into the fixed-capacity deck, replacing its contents. No heap
+    * allocations are made once the per-thread buffer has warmed up.
+    * @param deck_code std::string_view,
+    *      the deck code to decode
+    * @param deck InlineDeck<N>,
+    *      the deck receiving the cards in code order. Throws std::length_error if the code holds
+    *      more than N cards.
+    */
+   template < size_t N >
+   static void decode(std::string_view deck_code, InlineDeck< N > &deck);
+   /**
+    * Decode the deck code and hand every contained card to the callback, without collecting the
+    * cards in a container. Apart from warming up a per-thread buffer on first use, no heap
+    * allocations are made.
+    * @param deck_code std::string_view,
+    *      the deck code to decode
+    * @param emit Callback,
+    *      the callable receiving each card as (CardId, size_t count)
+    */
+   template < typename Callback >
+   static void decode_each(std::string_view deck_code, Callback &&emit);
+   /**
+    * Rewrite the deck code into the canonical code encode() produces for its deck. Lower case,
+    * separators, padding and any group or card order of other encoders are normalized, so that
+    * equal decks compare equal as codes. The cards only pass through as packed ids, no card code
+    * strings are built.
+    * @param deck_code std::string_view,
+    *      the deck code to normalize
+    * @return std::string,
+    *      the canonical deck code. Throws std::invalid_argument if the code cannot be decoded.
+    */
+   static std::string canonicalize(std::string_view deck_code);
+   /**
+    * Hash the contents of the deck code. The cards are fed from the byte stream straight into a
+    * FingerprintBuilder, so that no strings or containers are built. Codes of equal decks share
+    * the fingerprint, however they are formatted or ordered.
+    * @param deck_code std::string_view,
+    *      the deck code to hash
+    * @return Fingerprint,
+    *      the fingerprint of the deck. Throws std::invalid_argument if the code cannot be decoded.
+    */
+   static Fingerprint fingerprint(std::string_view deck_code);
+   /**
+    * Compute the card-level difference between two decks by a merge of their cards sorted by
+    * packed id. Cards listed more than once in a code are counted together.
+    * @param from_code std::string_view,
+    *      the code of the old deck
+    * @param to_code std::string_view,
+    *      the code of the new deck
+    * @return std::vector<CardDelta>,
+    *      the cards whose count changed with their count deltas, sorted by id. Throws
+    *      std::invalid_argument if a code cannot be decoded.
+    */
+   static std::vector< CardDelta > diff(std::string_view from_code, std::string_view to_code);
+   /**
+    * Apply a difference as computed by diff() to a deck, so that
+    *      apply_patch(a, diff(a, b)) == canonicalize(b)
+    * @param deck_code std::string_view,
+    *      the code of the deck to patch
+    * @param patch std::vector<CardDelta>,
+    *      the count deltas, in any order
+    * @return std::string,
+    *      the code of the patched deck. Throws std::invalid_argument if the code cannot be
+    *      decoded or the patch removes more copies of a card than the deck holds.
+    */
+   static std::string apply_patch(
+      std::string_view deck_code, const std::vector< CardDelta > &patch);
+   /**
+    * Decode the deck code without any allocation, so that hard-coded codes can be resolved at
+    * compile time:
+    *      constexpr auto deck = DeckCodec::decode_ct< 40 >("CEBAI...");
+    * A malformed code throws, which fails the compilation if evaluated in a constant expression.
+    * @param deck_code std::string_view,
+    *      the deck code to decode
+    * @return InlineDeck<N>,
+    *      the deck extracted from the code. Throws std::length_error if it holds more than N cards.
+    */
+   template < size_t N >
+   static constexpr InlineDeck< N > decode_ct(std::string_view deck_code);
+   /**
+    * Encode the deck without any allocation, so that the code of a hard-coded deck can be built at
+    * compile time. The code is identical to the one of encode().
+    * @param deck InlineDeck<N>,
+    *      the deck to encode
+    * @return StaticCode,
+    *      the encoded deck code, large enough for any deck of N cards
+    */
+   template < size_t N >
+   static constexpr auto encode_ct(const InlineDeck< N > &deck);
+   /**
+    * Decode a batch of deck codes in parallel. A code that fails to decode does not abort the
+    * batch, its error message is reported in its result slot instead.
+    * @param codes CodeContainer,
+    *      random access container of deck codes convertible to std::string_view
+    * @param out RandomIt,
+    *      iterator to the first of codes.size() preallocated BatchItem<std::vector<CodeCountType>>
+    *      slots, which receive the results in input order
+    * @param pool ThreadPool,
+    *      the pool to run on
+    */
+   template < typename CodeCountType, typename CodeContainer, typename RandomIt >
+   static void decode_batch_to(
+      const CodeContainer &codes, RandomIt out, ThreadPool &pool = ThreadPool::global());
+   /**
+    * Decode a batch of deck codes in parallel.
+    * @return std::vector<BatchItem>,
+    *      the decoded decks or error messages in input order
+    */
+   template < typename CodeCountType, typename CodeContainer >
+   static std::vector< BatchItem< std::vector< CodeCountType > > > decode_batch(
+      const CodeContainer &codes, ThreadPool &pool = ThreadPool::global());
+   /**
+    * Decode a batch of deck codes in parallel straight into the columns of a DeckBatch. A code
+    * that fails to decode leaves an empty deck and is listed in the failed column.
+    * @param codes CodeContainer,
+    *      random access container of deck codes convertible to std::string_view
+    * @param batch DeckBatch,
+    *      the batch to append the decks to in input order
+    * @param pool ThreadPool,
+    *      the pool to run on
+    */
+   template < typename CodeContainer >
+   static void decode_batch_into(
+      const CodeContainer &codes, DeckBatch &batch, ThreadPool &pool = ThreadPool::global());
+   /**
+    * Fingerprint a batch of deck codes in parallel. A code that fails to decode does not abort the
+    * batch, its error message is reported in its result slot instead.
+    * @param codes CodeContainer,
+    *      random access container of deck codes convertible to std::string_view
+    * @param out RandomIt,
+    *      iterator to the first of codes.size() preallocated BatchItem<Fingerprint> slots, which
+    *      receive the results in input order
+    * @param pool ThreadPool,
+    *      the pool to run on
+    */
+   template < typename CodeContainer, typename RandomIt >
+   static void fingerprint_batch_to(
+      const CodeContainer &codes, RandomIt out, ThreadPool &pool = ThreadPool::global());
+   /**
+    * Fingerprint a batch of deck codes in parallel.
+    * @return std::vector<BatchItem>,
+    *      the fingerprints or error messages in input order
+    */
+   template < typename CodeContainer >
+   static std::vector< BatchItem< Fingerprint > > fingerprint_batch(
+      const CodeContainer &codes, ThreadPool &pool = ThreadPool::global());
+   /**
+    * Diff one deck against a batch of decks in parallel, decoding the common deck only once. A code
+    * that fails to decode does not abort the batch, its error message is reported in its result
+    * slot instead; an invalid from_code throws std::invalid_argument right away.
+    * @param from_code std::string_view,
+    *      the code of the deck compared against all others
+    * @param codes CodeContainer,
+    *      random access container of deck codes convertible to std::string_view
+    * @param out RandomIt,
+    *      iterator to the first of codes.size() preallocated BatchItem<std::vector<CardDelta>>
+    *      slots, which receive diff(from_code, codes[i]) in input order
+    * @param pool ThreadPool,
+    *      the pool to run on
+    */
+   template < typename CodeContainer, typename RandomIt >
+   static void diff_batch_to(
+      std::string_view from_code,
+      const CodeContainer &codes,
+      RandomIt out,
+      ThreadPool &pool = ThreadPool::global());
+   /**
+    * Diff one deck against a batch of decks in parallel.
+    * @return std::vector<BatchItem>,
+    *      the differences or error messages in input order
+    */
+   template < typename CodeContainer >
+   static std::vector< BatchItem< std::vector< CardDelta > > > diff_batch(
+      std::string_view from_code,
+      const CodeContainer &codes,
+      ThreadPool &pool = ThreadPool::global());
+   /**
+    * Encode a batch of decks in parallel. A deck that fails to encode does not abort the batch,
+    * its error message is reported in its result slot instead.
+    * @param decks DeckContainers,
+    *      random access container of decks
+    * @param out RandomIt,
+    *      iterator to the first of decks.size() preallocated BatchItem<std::string> slots, which
+    *      receive the results in input order
+    * @param pool ThreadPool,
+    *      the pool to run on
+    */
+   template < typename DeckContainers, typename RandomIt >
+   static void encode_batch_to(
+      const DeckContainers &decks, RandomIt out, ThreadPool &pool = ThreadPool::global());
+   /**
+    * Encode a batch of decks in parallel.
+    * @return std::vector<BatchItem>,
+    *      the deck codes or error messages in input order
+    */
+   template < typename DeckContainers >
+   static std::vector< BatchItem< std::string > > encode_batch(
+      const DeckContainers &decks, ThreadPool &pool = ThreadPool::global());
    /**
     * Check the given deck design for correctness. The following errors are
     * checked:
@@ -69,49 +346,170 @@ class DeckCodec {
     *      the card number repsectively
     */
    static std::tuple< int, Region, int > parse_card_code(const std::string &code);
+   /**
+    * Parses the card code XXYYZZZ into its packed id.
+    * @param code std::string_view,
+    *      the card code to parse
+    * @return CardId,
+    *      the packed id of the card. Throws std::invalid_argument for malformed codes.
+    */
+   static CardId parse_card_id(std::string_view code);
+   /**
+    * Builds the card code XXYYZZZ of a packed card id.
+    * @param id CardId,
+    *      the packed id
+    * @return std::string,
+    *      the card code
+    */
+   static std::string card_code(CardId id);
 
   private:
-   static const size_t CARD_CODE_LENGTH = 7;
-   static const size_t FORMAT = 1;
-   static const size_t VERSION = 3;
-   static const size_t MAX_KNOWN_VERSION = 3;
-
-   static const std::map< Region, size_t > &region_to_id();
-   static const std::map< size_t, Region > &id_to_region();
-   static const std::map< Region, std::string > &region_to_str();
-   static const std::map< std::string, Region > &str_to_region();
-
-   static Region _to_region(const std::string &str) { return str_to_region().at(str); }
-   static std::string _to_str(Region reg) { return region_to_str().at(reg); }
-   static Region _to_region(size_t id) { return id_to_region().at(id); }
-   static size_t _to_int(Region reg) { return region_to_id().at(reg); }
-
-   static bool _parseable_as_int(const std::string &s);
-   /**
-    * Sorts in-place the groups of set-faction combination. Each group is first
-    * sorted by the number of card tokens contained, and, if required, by the
-    * alphanumeric precedence of the code of their first entry as tiebreaker. In a
-    * second step in-group sorting is done via alphanumerical card code comparison.
-    * sorting step
-    * @param group_of std::vector<std::vector>>,
-    *      the vector holding the set-faction groups
-    * @return std::vector&,
-    *      the given reference to the input variable to allow chaining of commands.
+   /// measures the internal encoding stages in the deck_benchmarks target
+   friend class CodecBenchmarks;
+   /// keeps the encoded groups of a deck under construction
+   friend class DeckBuilder;
+
+   static constexpr size_t CARD_CODE_LENGTH = 7;
+   static constexpr size_t FORMAT = 1;
+   /// the lowest version written, decks holding newer regions get the version of their newest one
+   static constexpr size_t VERSION = 3;
+   static constexpr size_t MAX_KNOWN_VERSION = 5;
+   /// byte streams up to this size are decoded on the stack, covering decks of hundreds of cards
+   static constexpr size_t MAX_STACK_BYTES = 1024;
+
+   static constexpr bool _is_known(Region reg)
+   {
+      return static_cast< size_t >(reg) < REGION_INFO.size();
+   }
+   static constexpr Region _to_region(uint64_t id)
+   {
+      if(id >= REGION_BY_ID.size() || REGION_BY_ID[id] == NO_REGION) {
+         throw std::invalid_argument("Unknown region id: " + std::to_string(id));
+      }
+      return static_cast< Region >(REGION_BY_ID[id]);
+   }
+   static constexpr uint32_t _to_int(Region reg)
+   {
+      return REGION_INFO[static_cast< size_t >(reg)].id;
+   }
+   /// the version a code holding a card of the region needs at least
+   static constexpr size_t _version_of(Region reg)
+   {
+      return std::max< size_t >(VERSION, REGION_INFO[static_cast< size_t >(reg)].version);
+   }
+
+   static bool _try_parse_card_id(std::string_view code, CardId &id);
+   /**
+    * The key by which card ids are ordered in the canonical encoding. Comparing keys is equivalent
+    * to comparing the card codes alphanumerically.
     */
-   template < typename CodeCountType >
-   static std::vector< std::vector< CodeCountType > > &_sort_groups(
-      std::vector< std::vector< CodeCountType > > &group_of);
+   static constexpr uint32_t _code_order(CardId id)
+   {
+      return (id.set() << 24U) | (INITIALS_RANK[static_cast< size_t >(id.region())] << 16U)
+             | id.number();
+   }
+   /// the most bytes a single card can take up in the byte stream
+   static const size_t MAX_BYTES_PER_CARD = 16;
+   /// an upper bound on the size of the byte stream of a deck of n_cards cards
+   static constexpr size_t _max_byte_count(size_t n_cards)
+   {
+      // the format byte and the three group counts precede the cards
+      return 1 + 3 * Varint::MAX_BYTES + n_cards * MAX_BYTES_PER_CARD;
+   }
+
+   /**
+    * The reusable buffers of the encoding pipeline. Every thread owns one instance, so that
+    * repeated encodes only clear them and do not allocate once the capacities have warmed up.
+    */
+   struct EncodeScratch {
+      /// the cards of counts 1, 2, 3 and 4+ respectively
+      std::array< std::vector< CardIdCount >, 4 > by_count;
+      /// the [begin, end) index ranges of the set-faction groups within a count vector
+      std::vector< std::pair< size_t, size_t > > group_bounds;
+      std::string bytes;
+   };
+   static EncodeScratch &_scratch();
+   /**
+    * Parses the deck into the scratch buffers and encodes it as raw byte stream.
+    * @param deck DeckContainer,
+    *      the deck to encode
+    * @return std::string_view,
+    *      the byte stream, which remains valid until the next encode on this thread
+    */
+   template < typename DeckContainer >
+   static std::string_view _encode_bytes(const DeckContainer &deck);
+   /**
+    * Encodes the cards already sorted into the count buckets of the scratch.
+    */
+   static std::string_view _encode_scratch(EncodeScratch &scratch);
+   /**
+    * Decodes the deck code and hands every contained card to the callback as (CardId, count).
+    * @param deck_code std::string_view,
+    *      the deck code to decode
+    * @param emit Callback,
+    *      the callable receiving each card
+    */
+   template < typename Callback >
+   static void _decode_ids(std::string_view deck_code, Callback &&emit);
+   /**
+    * Decodes the deck code into the vector, sorted by packed id with the counts of repeated cards
+    * summed.
+    */
+   static void _decode_sorted(std::string_view deck_code, std::vector< CardIdCount > &cards);
+   /**
+    * Appends the count deltas from one deck to another, both as given by _decode_sorted.
+    */
+   static void _diff_sorted(
+      const std::vector< CardIdCount > &from,
+      const std::vector< CardIdCount > &to,
+      std::vector< CardDelta > &deltas);
+   /**
+    * Decodes the deck code and appends the cards to the given vector.
+    */
+   template < typename Vector >
+   static void _decode_into(std::string_view deck_code, Vector &result);
+   /**
+    * Walks the base32-decoded byte stream in place with a read cursor and hands every contained
+    * card to the callback as (CardId, count). Usable in constant expressions.
+    * @param bytes std::string_view,
+    *      the raw byte stream, including the leading format and version byte
+    * @param emit Callback,
+    *      the callable receiving each card
+    */
+   template < typename Callback >
+   static constexpr void _decode_byte_stream(std::string_view bytes, Callback &&emit);
+   /**
+    * The constant expression counterpart of _encode_bytes. Sorts the cards of each count by their
+    * code order, which makes the set-faction groups contiguous, and then orders the groups by size.
+    * @param deck InlineDeck<N>,
+    *      the deck to encode
+    * @param out char*,
+    *      the output, which has to hold _max_byte_count(N) bytes
+    * @return size_t,
+    *      the number of bytes written
+    */
+   template < size_t N >
+   static constexpr size_t _encode_bytes_ct(const InlineDeck< N > &deck, char *out);
+   /**
+    * Sorts the groups of set-faction combination by the number of card tokens contained, and, if
+    * required, by the alphanumeric precedence of the code of their first entry as tiebreaker.
+    * @param group_bounds std::vector<std::pair>,
+    *      the index ranges of the groups as found by _group_cards, sorted in place
+    */
+   static void _sort_groups(std::vector< std::pair< size_t, size_t > > &group_bounds);
    /**
     * Split the cards (which are assumed to have already been pre-selected in terms of count, i.e.
-    * all cards in this vector have equal count) in set-faction groups.
+    * all cards in this vector have equal count) in set-faction groups in a single pass. The cards
+    * are sorted by card code; set and faction make up the leading part of the code, so that each
+    * group becomes a contiguous run, itself sorted by code, and the runs follow the code order of
+    * their first entries.
     * @param cards std::vector,
     *      the card vector to group
-    * @return std::vector<std::vector>>,
-    *      the grouped cards vector containing the group vectors
+    * @param group_bounds std::vector<std::pair>,
+    *      the [begin, end) index ranges of the found groups
     */
-   template < typename CodeCountType >
-   static std::vector< std::vector< CodeCountType > > _group_cards(
-      std::vector< CodeCountType > &cards);
+   static void _group_cards(
+      std::vector< CardIdCount > &cards, std::vector< std::pair< size_t, size_t > > &group_bounds);
    /**
     * Encodes the group of 4+ count card tokens, as these are handled more
     * simplistically.
@@ -120,123 +518,326 @@ class DeckCodec {
     * @param Nofs std::vector,
     *      the card token vector holding all 4+ count card tokens.
     */
-   template < typename CodeCountType >
-   static void _encode_Nof(std::string &bytes, const std::vector< CodeCountType > &Nofs);
+   static void _encode_Nof(std::string &bytes, const std::vector< CardIdCount > &Nofs);
    /**
     * Encodes the groups of set-faction combinations in the stream
     * @param bytes std::string,
     *      the byte stream to write to
-    * @param groups std::vector<std::vector>,
-    *      the group vector to encode
+    * @param cards std::vector,
+    *      the grouped cards
+    * @param group_bounds std::vector<std::pair>,
+    *      the index ranges of the groups to encode
     */
-   template < typename CodeCountType >
    static void _encode_groups(
-      std::string &bytes, const std::vector< std::vector< CodeCountType > > &groups);
+      std::string &bytes,
+      const std::vector< CardIdCount > &cards,
+      const std::vector< std::pair< size_t, size_t > > &group_bounds);
 
    /**
-    * Sorts the group of card tokens by the alphanumeric precedence of card codes.
-    * @param group_Nof std::vector,
-    *      the group vector
+    * Sorts the range of card tokens by the alphanumeric precedence of card codes.
+    * @param first, last iterators,
+    *      the range to sort
     */
-   template < typename CodeCountType >
-   static void _sort_by_code(std::vector< CodeCountType > &group_Nof);
+   static void _sort_by_code(
+      std::vector< CardIdCount >::iterator first, std::vector< CardIdCount >::iterator last);
 
-   static inline void append_varint(std::string &stream, const Varint &vint)
-   {
-      stream.insert(stream.end(), vint.begin(), vint.end());
-   }
+   /**
+    * Makes room for the given number of varints of maximal length behind the byte stream, which
+    * the encoders write in place and trim to the written bytes afterwards. As the stream lives in
+    * the thread's scratch, its capacity is reused and growing it does not allocate.
+    * @return char*,
+    *      the write position, the former end of the stream
+    */
+   static char *_grow(std::string &bytes, size_t n_varints);
 };
 
 template < typename DeckContainer >
 bool DeckCodec::verify(const DeckContainer &deck_comp)
 {
    return std::all_of(deck_comp.begin(), deck_comp.end(), [](const auto &deck_card) {
-      if(deck_card.code().size() != CARD_CODE_LENGTH) {
-         return false;
-      }
-      auto card_code = deck_card.code();
-
-      if(not _parseable_as_int(card_code.substr(0, 2))) {
-         return false;
-      }
-      if(str_to_region().find(card_code.substr(2, 2)) == str_to_region().end()) {
-         return false;
-      }
-      if(not _parseable_as_int(card_code.substr(4, 3))) {
-         return false;
-      }
-      if(deck_card.count() < 1) {
-         return false;
+      using CardT = std::decay_t< decltype(deck_card) >;
+      if constexpr(std::is_same_v< CardT, CardIdCount >) {
+         return deck_card.second >= 1 && _is_known(deck_card.first.region());
+      } else {
+         CardId id;
+         return _try_parse_card_id(deck_card.code(), id) && deck_card.count() >= 1;
       }
-      return true;
    });
 }
 
 template < typename DeckContainer >
 std::string DeckCodec::encode(const DeckContainer &deck)
 {
-   if(not verify(deck)) {
-      throw std::invalid_argument("The provided deck contains invalid card codes.");
-   }
+   return base32::encode(_encode_bytes(deck));
+}
 
-   using CardT = typename DeckContainer::value_type;
+template < typename DeckContainer >
+std::pmr::string DeckCodec::encode(const DeckContainer &deck, std::pmr::memory_resource *resource)
+{
+   std::string_view bytes = _encode_bytes(deck);
+   std::pmr::string code(base32::encoded_size(bytes.size()), '\0', resource);
+   base32::encode_to(bytes, code.data(), code.size());
+   return code;
+}
+
+template < typename DeckContainer >
+size_t DeckCodec::encode_to(const DeckContainer &deck, char *out, size_t capacity)
+{
+   return base32::encode_to(_encode_bytes(deck), out, capacity);
+}
+
+template < typename DeckContainer, typename OutputIt >
+OutputIt DeckCodec::encode_to(const DeckContainer &deck, OutputIt out)
+{
+   return base32::encode_to(_encode_bytes(deck), out);
+}
 
-   std::string result{(FORMAT << 4) | VERSION};  // i.e. 00010011 = 19
+template < typename DeckContainer >
+size_t DeckCodec::max_encoded_size(const DeckContainer &deck)
+{
+   return base32::encoded_size(_max_byte_count(deck.size()));
+}
+
+template < typename DeckContainer >
+std::string_view DeckCodec::_encode_bytes(const DeckContainer &deck)
+{
+   using CardT = typename DeckContainer::value_type;
 
-   std::array< std::vector< CardT >, 3 > groups_of_Xs;
-   std::vector< CardT > group_of_N;
+   EncodeScratch &scratch = _scratch();
+   for(auto &bucket : scratch.by_count) {
+      bucket.clear();
+   }
    for(const auto &deck_card : deck) {
-      if(auto count = deck_card.count(); count == 3) {
-         groups_of_Xs[2].emplace_back(deck_card);
-      } else if(count == 2) {
-         groups_of_Xs[1].emplace_back(deck_card);
-      } else if(count == 1) {
-         groups_of_Xs[0].emplace_back(deck_card);
-      } else if(count < 1) {
-         throw std::invalid_argument(
-            "Invalid count of " + std::to_string(count) + " for card " + deck_card.code());
+      CardIdCount card;
+      bool valid;
+      if constexpr(std::is_same_v< CardT, CardIdCount >) {
+         card = deck_card;
+         valid = _is_known(card.first.region());
       } else {
-         group_of_N.emplace_back(deck_card);
+         card.second = deck_card.count();
+         valid = _try_parse_card_id(deck_card.code(), card.first);
       }
+      if(not valid || card.second < 1) {
+         throw std::invalid_argument("The provided deck contains invalid card codes.");
+      }
+      scratch.by_count[std::min(card.second, size_t(4)) - 1].emplace_back(card);
    }
-
-   // Encode
-   for(auto &group_Xofs : reverse(groups_of_Xs)) {
-      // build the lists of set and faction combinations within the groups of
-      // similar card
-      auto groups = _group_cards(group_Xofs);
-      // to ensure that the same decklist in any order produces the same code,
-      // sort them
-      _sort_groups(groups);
-      _encode_groups(result, groups);
-   }
-   _sort_by_code(group_of_N);
-   _encode_Nof(result, group_of_N);
-   return base32::encode(result);
+   return _encode_scratch(scratch);
 }
 
 template < typename CodeCountType >
-std::vector< CodeCountType > DeckCodec::decode(const std::string &deck_code)
+std::vector< CodeCountType > DeckCodec::decode(std::string_view deck_code)
 {
    std::vector< CodeCountType > result;
-   std::string bytes;
+   _decode_into(deck_code, result);
+   return result;
+}
+
+template < typename CodeCountType >
+std::pmr::vector< CodeCountType > DeckCodec::decode(
+   std::string_view deck_code, std::pmr::memory_resource *resource)
+{
+   std::pmr::vector< CodeCountType > result(resource);
+   _decode_into(deck_code, result);
+   return result;
+}
+
+template < size_t N >
+void DeckCodec::decode(std::string_view deck_code, InlineDeck< N > &deck)
+{
+   deck.clear();
+   _decode_ids(deck_code, [&deck](CardId id, size_t count) { deck.push_back(id, count); });
+}
+
+template < typename Vector >
+void DeckCodec::_decode_into(std::string_view deck_code, Vector &result)
+{
+   using CodeCountType = typename Vector::value_type;
+   _decode_ids(deck_code, [&](CardId id, size_t count) {
+      if constexpr(std::is_constructible_v< CodeCountType, CardId, size_t >) {
+         result.emplace_back(id, count);
+      } else {
+         result.emplace_back(card_code(id), count);
+      }
+   });
+}
+
+template < typename CodeCountType, typename CodeContainer, typename RandomIt >
+void DeckCodec::decode_batch_to(const CodeContainer &codes, RandomIt out, ThreadPool &pool)
+{
+   pool.parallel_for(codes.size(), 0, [&](size_t begin, size_t end) {
+      for(size_t i = begin; i < end; i++) {
+         auto &slot = out[static_cast< std::ptrdiff_t >(i)];
+         slot.value.clear();
+         slot.error.clear();
+         try {
+            _decode_into(std::string_view(codes[i]), slot.value);
+         } catch(std::exception &e) {
+            slot.value.clear();
+            slot.error = e.what();
+         }
+      }
+   });
+}
+
+template < typename CodeCountType, typename CodeContainer >
+std::vector< BatchItem< std::vector< CodeCountType > > > DeckCodec::decode_batch(
+   const CodeContainer &codes, ThreadPool &pool)
+{
+   std::vector< BatchItem< std::vector< CodeCountType > > > result(codes.size());
+   decode_batch_to< CodeCountType >(codes, result.begin(), pool);
+   return result;
+}
+
+template < typename CodeContainer >
+void DeckCodec::decode_batch_into(const CodeContainer &codes, DeckBatch &batch, ThreadPool &pool)
+{
+   // a few parts per worker for balance, decoded separately and then stitched together
+   size_t n_parts = std::min(codes.size(), std::max(pool.size(), size_t(1)) * 4);
+   std::vector< DeckBatch > parts(n_parts);
+   pool.parallel_for(n_parts, 1, [&](size_t begin, size_t end) {
+      for(size_t p = begin; p < end; p++) {
+         for(size_t i = p * codes.size() / n_parts; i < (p + 1) * codes.size() / n_parts; i++) {
+            try {
+               _decode_ids(std::string_view(codes[i]), [&parts, p](CardId id, size_t count) {
+                  parts[p].add_card(id, count);
+               });
+               parts[p].finish_deck();
+            } catch(std::exception &) {
+               parts[p].fail_deck();
+            }
+         }
+      }
+   });
+   batch.append(parts, pool);
+}
+
+template < typename CodeContainer, typename RandomIt >
+void DeckCodec::fingerprint_batch_to(const CodeContainer &codes, RandomIt out, ThreadPool &pool)
+{
+   pool.parallel_for(codes.size(), 0, [&](size_t begin, size_t end) {
+      for(size_t i = begin; i < end; i++) {
+         auto &slot = out[static_cast< std::ptrdiff_t >(i)];
+         slot.value = Fingerprint();
+         slot.error.clear();
+         try {
+            slot.value = fingerprint(std::string_view(codes[i]));
+         } catch(std::exception &e) {
+            slot.error = e.what();
+         }
+      }
+   });
+}
+
+template < typename CodeContainer >
+std::vector< BatchItem< Fingerprint > > DeckCodec::fingerprint_batch(
+   const CodeContainer &codes, ThreadPool &pool)
+{
+   std::vector< BatchItem< Fingerprint > > result(codes.size());
+   fingerprint_batch_to(codes, result.begin(), pool);
+   return result;
+}
+
+template < typename CodeContainer, typename RandomIt >
+void DeckCodec::diff_batch_to(
+   std::string_view from_code, const CodeContainer &codes, RandomIt out, ThreadPool &pool)
+{
+   std::vector< CardIdCount > from;
+   _decode_sorted(from_code, from);
+   pool.parallel_for(codes.size(), 0, [&](size_t begin, size_t end) {
+      thread_local std::vector< CardIdCount > to;
+      for(size_t i = begin; i < end; i++) {
+         auto &slot = out[static_cast< std::ptrdiff_t >(i)];
+         slot.value.clear();
+         slot.error.clear();
+         try {
+            _decode_sorted(std::string_view(codes[i]), to);
+            _diff_sorted(from, to, slot.value);
+         } catch(std::exception &e) {
+            slot.value.clear();
+            slot.error = e.what();
+         }
+      }
+   });
+}
+
+template < typename CodeContainer >
+std::vector< BatchItem< std::vector< CardDelta > > > DeckCodec::diff_batch(
+   std::string_view from_code, const CodeContainer &codes, ThreadPool &pool)
+{
+   std::vector< BatchItem< std::vector< CardDelta > > > result(codes.size());
+   diff_batch_to(from_code, codes, result.begin(), pool);
+   return result;
+}
+
+template < typename DeckContainers, typename RandomIt >
+void DeckCodec::encode_batch_to(const DeckContainers &decks, RandomIt out, ThreadPool &pool)
+{
+   pool.parallel_for(decks.size(), 0, [&](size_t begin, size_t end) {
+      for(size_t i = begin; i < end; i++) {
+         auto &slot = out[static_cast< std::ptrdiff_t >(i)];
+         slot.value.clear();
+         slot.error.clear();
+         try {
+            std::string_view bytes = _encode_bytes(decks[i]);
+            slot.value.resize(base32::encoded_size(bytes.size()));
+            base32::encode_to(bytes, slot.value.data(), slot.value.size());
+         } catch(std::exception &e) {
+            slot.value.clear();
+            slot.error = e.what();
+         }
+      }
+   });
+}
+
+template < typename DeckContainers >
+std::vector< BatchItem< std::string > > DeckCodec::encode_batch(
+   const DeckContainers &decks, ThreadPool &pool)
+{
+   std::vector< BatchItem< std::string > > result(decks.size());
+   encode_batch_to(decks, result.begin(), pool);
+   return result;
+}
+
+template < typename Callback >
+void DeckCodec::decode_each(std::string_view deck_code, Callback &&emit)
+{
+   _decode_ids(deck_code, std::forward< Callback >(emit));
+}
+
+template < typename Callback >
+void DeckCodec::_decode_ids(std::string_view deck_code, Callback &&emit)
+{
+   // the byte stream lives in this call, since the callback may decode further codes itself
+   std::array< char, MAX_STACK_BYTES > stack_bytes;
+   std::string heap_bytes;
+   char *bytes = stack_bytes.data();
+   if(base32::decoded_capacity(deck_code.size()) > stack_bytes.size()) {
+      heap_bytes.resize(base32::decoded_capacity(deck_code.size()));
+      bytes = heap_bytes.data();
+   }
+   size_t n_bytes = 0;
 
    try {
-      bytes = base32::decode(deck_code);
+      n_bytes = base32::decode_to(deck_code, bytes);
    } catch(std::invalid_argument &e) {
       throw std::invalid_argument(
          std::string("base32 decoding failed with the message: ") + e.what());
    }
+   _decode_byte_stream(std::string_view(bytes, n_bytes), std::forward< Callback >(emit));
+}
+
+template < typename Callback >
+constexpr void DeckCodec::_decode_byte_stream(std::string_view bytes, Callback &&emit)
+{
    if(bytes.empty()) {
       throw std::invalid_argument("base32 decoding led to empty byte string.");
    }
-   // a copy of the decoded bytes
-   std::string byte_list = bytes;
+   const char *cursor = bytes.data();
+   const char *end = bytes.data() + bytes.size();
 
    // grab format and version
-   size_t format = bytes[0] >> 4U;
-   size_t version = bytes[0] & 0xF;
-   byte_list.erase(byte_list.begin());
+   size_t version = static_cast< uint8_t >(*cursor++) & 0xFU;
 
    if(version > MAX_KNOWN_VERSION) {
       throw std::invalid_argument(
@@ -244,23 +845,24 @@ std::vector< CodeCountType > DeckCodec::decode(const std::string &deck_code)
          "of this library; please update.");
    }
 
-   for(size_t i = 3; i > 0; i--) {
-      int num_group_ofs = Varint::pop_varint(byte_list);
-
-      for(int j = 0; j < num_group_ofs; j++) {
-         int num_ofs_in_this_group = Varint::pop_varint(byte_list);
-         int set = Varint::pop_varint(byte_list);
-         Region region = _to_region(Varint::pop_varint(byte_list));
+   auto read_id = [&](uint64_t set, Region region) {
+      uint64_t number = Varint::read_varint(cursor, end);
+      if(set > CardId::MAX_SET || number > CardId::MAX_NUMBER) {
+         throw std::invalid_argument("Card set or number out of range.");
+      }
+      return CardId(static_cast< uint32_t >(set), region, static_cast< uint32_t >(number));
+   };
 
-         for(int k = 0; k < num_ofs_in_this_group; k++) {
-            int card = Varint::pop_varint(byte_list);
+   for(size_t i = 3; i > 0; i--) {
+      uint64_t num_group_ofs = Varint::read_varint(cursor, end);
 
-            std::string set_string = string_utils::pad_left(std::to_string(set), 2, '0');
-            std::string region_string = _to_str(region);
-            std::string card_string = string_utils::pad_left(std::to_string(card), 3, '0');
+      for(uint64_t j = 0; j < num_group_ofs; j++) {
+         uint64_t num_ofs_in_this_group = Varint::read_varint(cursor, end);
+         uint64_t set = Varint::read_varint(cursor, end);
+         Region region = _to_region(Varint::read_varint(cursor, end));
 
-            CodeCountType new_entry{set_string.append(region_string).append(card_string), i};
-            result.emplace_back(new_entry);
+         for(uint64_t k = 0; k < num_ofs_in_this_group; k++) {
+            emit(read_id(set, region), i);
          }
       }
    }
@@ -268,138 +870,135 @@ std::vector< CodeCountType > DeckCodec::decode(const std::string &deck_code)
    // the remainder of the deck code is comprised of entries for cards with
    // counts >= 4 this will only happen in Limited and special game modes. the
    // encoding is simply [count] [cardcode]
-   while(not byte_list.empty()) {
-      size_t four_plus_count = Varint::pop_varint(byte_list);
-      int four_plus_set = Varint::pop_varint(byte_list);
-      Region four_plus_faction = _to_region(Varint::pop_varint(byte_list));
-      int four_plus_number = Varint::pop_varint(byte_list);
-
-      std::string four_plus_set_string = string_utils::pad_left(
-         std::to_string(four_plus_set), 2, '0');
-      std::string four_plus_faction_string = _to_str(four_plus_faction);
-      std::string four_plus_number_string = string_utils::pad_left(
-         std::to_string(four_plus_number), 3, '0');
-
-      CodeCountType newEntry{
-         four_plus_set_string.append(four_plus_faction_string).append(four_plus_number_string),
-         four_plus_count};
-      result.emplace_back(newEntry);
+   while(cursor != end) {
+      size_t four_plus_count = Varint::read_varint(cursor, end);
+      uint64_t four_plus_set = Varint::read_varint(cursor, end);
+      Region four_plus_faction = _to_region(Varint::read_varint(cursor, end));
+
+      emit(read_id(four_plus_set, four_plus_faction), four_plus_count);
    }
-   return result;
 }
 
-template < typename CodeCountType >
-std::vector< std::vector< CodeCountType > > &DeckCodec::_sort_groups(
-   std::vector< std::vector< CodeCountType > > &group_of)
+template < size_t N >
+constexpr InlineDeck< N > DeckCodec::decode_ct(std::string_view deck_code)
 {
-   std::stable_sort(
-      group_of.begin(),
-      group_of.end(),
-      [](const std::vector< CodeCountType > &g1, const std::vector< CodeCountType > &g2) {
-         auto s1 = g1.size();
-         auto s2 = g2.size();
-         return (s1 < s2) || (s1 == s2) && (g1[0].code() < g2[0].code());
-      });
-
-   for(auto &g : group_of) {
-      _sort_by_code(g);
+   constexpr size_t max_bytes = _max_byte_count(N);
+   if(base32::decoded_capacity(deck_code.size()) > max_bytes) {
+      throw std::length_error("The deck code holds more cards than the deck can take.");
    }
-   return group_of;
+   std::array< char, max_bytes > bytes{};
+   size_t n_bytes = base32::decode_ct(deck_code, bytes.data());
+
+   InlineDeck< N > deck;
+   std::string_view stream(bytes.data(), n_bytes);
+   _decode_byte_stream(stream, [&deck](CardId id, size_t count) {
+      deck.push_back(id, count);
+   });
+   return deck;
 }
 
-template < typename CodeCountType >
-std::vector< std::vector< CodeCountType > > DeckCodec::_group_cards(
-   std::vector< CodeCountType > &cards)
+template < size_t N >
+constexpr auto DeckCodec::encode_ct(const InlineDeck< N > &deck)
 {
-   std::vector< std::vector< CodeCountType > > result;
-   while(not cards.empty()) {
-      std::vector< CodeCountType > current_set;
-
-      // get info from first
-      auto &first = cards.front();
-      std::string first_code = first.code();
-      auto [set, region, number] = parse_card_code(first_code);
-
-      // now add that to our new list, remove from old
-      current_set.emplace_back(first);
-      cards.erase(cards.begin());
-
-      // the weird lambda capturing is due to structured bindings [set,
-      // region,...] not being explicitly capturable by lambdas in C++17. The
-      // assignment is a workaround
-      auto ptr_to_start_erase = std::remove_if(
-         cards.begin(),
-         cards.end(),
-         [&set = set, &region = region, &current_set = current_set](const auto &card) {
-            std::string this_code = card.code();
-            int this_set = std::stoi(this_code.substr(0, 2));
-            Region this_region = _to_region(this_code.substr(2, 2));
-
-            if(this_set == set && this_region == region) {
-               // asside from removing the cards from the list, also
-               // store them in the current set vector
-               current_set.emplace_back(card);
-               return true;
-            }
-            return false;
-         });
-      cards.erase(ptr_to_start_erase, cards.end());
-      result.emplace_back(current_set);
-   }
-   return result;
+   constexpr size_t max_bytes = _max_byte_count(N);
+   std::array< char, max_bytes > bytes{};
+   size_t n_bytes = _encode_bytes_ct(deck, bytes.data());
+
+   StaticCode< base32::encoded_size(max_bytes) > code;
+   code.resize(base32::encode_ct(std::string_view(bytes.data(), n_bytes), code.data()));
+   return code;
 }
 
-template < typename CardCountType >
-void DeckCodec::_encode_groups(
-   std::string &bytes, const std::vector< std::vector< CardCountType > > &groups)
+template < size_t N >
+constexpr size_t DeckCodec::_encode_bytes_ct(const InlineDeck< N > &deck, char *out)
 {
-   auto n_groups_vint = Varint::from_int(groups.size());
-   append_varint(bytes, n_groups_vint);
-
-   for(const auto &group : groups) {
-      // how many cards in current group?
-      append_varint(bytes, Varint::from_int(group.size()));
-
-      // determine this group by first declaring the set number and faction
-      std::string curr_code = group[0].code();
-      auto [set, region, number] = parse_card_code(curr_code);
-      for(const auto &vint : {Varint::from_int(set), Varint::from_int(_to_int(region))}) {
-         append_varint(bytes, vint);
+   size_t version = VERSION;
+   for(const auto &[id, count] : deck) {
+      if(not _is_known(id.region()) || count < 1) {
+         throw std::invalid_argument("The provided deck contains invalid card codes.");
+      }
+      version = std::max(version, _version_of(id.region()));
+   }
+   size_t n_bytes = 0;
+   auto write = [&](uint64_t value) { n_bytes += Varint::write_varint(value, out + n_bytes); };
+   // insertion sort, as std::sort cannot run in constant expressions
+   auto sort_by = [](auto &values, size_t n, auto less) {
+      for(size_t i = 1; i < n; i++) {
+         for(size_t j = i; j > 0 && less(values[j], values[j - 1]); j--) {
+            auto tmp = values[j];
+            values[j] = values[j - 1];
+            values[j - 1] = tmp;
+         }
+      }
+   };
+   auto by_code = [](CardId a, CardId b) { return _code_order(a) < _code_order(b); };
+
+   out[n_bytes++] = static_cast< char >((FORMAT << 4) | version);
+   std::array< CardId, N > ids{};
+   // the [begin, end) ranges of the groups within ids
+   std::array< size_t, N > begins{};
+   std::array< size_t, N > ends{};
+   for(size_t count = 3; count > 0; count--) {
+      size_t n_ids = 0;
+      for(size_t i = 0; i < deck.size(); i++) {
+         if(deck.count(i) == count) {
+            ids[n_ids++] = deck.id(i);
+         }
       }
+      // the set and faction make up the upper bits of the code order, so each group becomes a
+      // contiguous run sorted by code
+      sort_by(ids, n_ids, by_code);
+      size_t n_groups = 0;
+      for(size_t i = 0; i < n_ids; i++) {
+         if(i == 0 || ids[i].group() != ids[i - 1].group()) {
+            begins[n_groups++] = i;
+         }
+         ends[n_groups - 1] = i + 1;
+      }
+      // the runs are ordered by code already, which settles the ties of a stable sort by size
+      std::array< size_t, N > order{};
+      for(size_t g = 0; g < n_groups; g++) {
+         order[g] = g;
+      }
+      sort_by(order, n_groups, [&](size_t g1, size_t g2) {
+         return ends[g1] - begins[g1] < ends[g2] - begins[g2];
+      });
 
-      // now the cards within this group, as identified by the third section of
-      // card code only now,
-      for(const auto &deck_card : group) {
-         std::string code = deck_card.code();
-         auto number_vint = Varint::from_int(std::stoi(code.substr(4, 3)));
-         append_varint(bytes, number_vint);
+      write(n_groups);
+      for(size_t g = 0; g < n_groups; g++) {
+         size_t begin = begins[order[g]];
+         size_t end = ends[order[g]];
+         write(end - begin);
+         write(ids[begin].set());
+         write(_to_int(ids[begin].region()));
+         for(size_t i = begin; i < end; i++) {
+            write(ids[i].number());
+         }
       }
    }
-}
-
-template < typename CardCountType >
-void DeckCodec::_encode_Nof(std::string &bytes, const std::vector< CardCountType > &Nofs)
-{
-   for(const auto &deck_card : Nofs) {
-      auto count_as_varint = Varint::from_int(deck_card.count());
-      bytes.insert(bytes.end(), count_as_varint.begin(), count_as_varint.end());
 
-      auto [set, region, number] = parse_card_code(deck_card.code());
-      int region_int = _to_int(region);
-
-      for(const auto &varint :
-          {Varint::from_int(set), Varint::from_int(region_int), Varint::from_int(number)}) {
-         append_varint(bytes, varint);
+   std::array< size_t, N > counts{};
+   size_t n_Nofs = 0;
+   for(size_t i = 0; i < deck.size(); i++) {
+      if(deck.count(i) > 3) {
+         ids[n_Nofs] = deck.id(i);
+         counts[n_Nofs++] = deck.count(i);
       }
    }
-}
-
-template < typename CardCountType >
-void DeckCodec::_sort_by_code(std::vector< CardCountType > &group_Nof)
-{
-   std::stable_sort(group_Nof.begin(), group_Nof.end(), [](const auto &dc1, const auto &dc2) {
-      return dc1.code() < dc2.code();
-   });
+   // sort indices so that the counts follow their cards
+   std::array< size_t, N > order{};
+   for(size_t i = 0; i < n_Nofs; i++) {
+      order[i] = i;
+   }
+   sort_by(order, n_Nofs, [&](size_t i, size_t j) { return by_code(ids[i], ids[j]); });
+   for(size_t i = 0; i < n_Nofs; i++) {
+      CardId id = ids[order[i]];
+      write(counts[order[i]]);
+      write(id.set());
+      write(_to_int(id.region()));
+      write(id.number());
+   }
+   return n_bytes;
 }
 
 #endif  // LORDECKENCODER_CODEC_H
@@ -0,0 +1,116 @@
+
+#ifndef LORDECKENCODER_CORPUS_H
+#define LORDECKENCODER_CORPUS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "deck_batch.h"
+#include "thread_pool.h"
+
+/**
+ * Read-only memory mapping of a whole file. On platforms without mmap the file is read into memory
+ * instead.
+ */
+class MappedFile {
+  public:
+   /// maps the file, throws std::runtime_error if it cannot be opened or mapped
+   explicit MappedFile(const std::string &path);
+   ~MappedFile();
+
+   MappedFile(const MappedFile &) = delete;
+   MappedFile &operator=(const MappedFile &) = delete;
+   MappedFile(MappedFile &&other) noexcept;
+   MappedFile &operator=(MappedFile &&other) noexcept;
+
+   [[nodiscard]] const char *data() const { return m_data; }
+   [[nodiscard]] size_t size() const { return m_size; }
+   [[nodiscard]] std::string_view view() const { return {m_data, m_size}; }
+
+  private:
+   void _release();
+
+   const char *m_data = nullptr;
+   size_t m_size = 0;
+   /// holds the contents where the file could not be mapped
+   std::vector< char > m_fallback;
+};
+
+/**
+ * Read-only view on columns written by DeckBatch::write, mapped from disk without copying or
+ * parsing.
+ */
+class MappedColumns {
+  public:
+   /**
+    * Maps the file, throws std::runtime_error if it is no column file, was cut short, or its deck
+    * offsets or failed decks are out of order or range.
+    */
+   explicit MappedColumns(const std::string &path);
+
+   [[nodiscard]] size_t size() const { return m_n_decks; }
+   [[nodiscard]] size_t n_cards() const { return m_n_cards; }
+   [[nodiscard]] size_t n_failed() const { return m_n_failed; }
+   [[nodiscard]] const uint64_t *deck_offsets() const { return m_deck_offsets; }
+   [[nodiscard]] const uint32_t *card_ids() const { return m_card_ids; }
+   [[nodiscard]] const uint32_t *counts() const { return m_counts; }
+   [[nodiscard]] const uint64_t *failed() const { return m_failed; }
+   [[nodiscard]] DeckSlice operator[](size_t idx) const
+   {
+      return DeckSlice(
+         m_card_ids + m_deck_offsets[idx],
+         m_counts + m_deck_offsets[idx],
+         m_deck_offsets[idx + 1] - m_deck_offsets[idx]);
+   }
+
+  private:
+   MappedFile m_file;
+   size_t m_n_decks = 0;
+   size_t m_n_cards = 0;
+   size_t m_n_failed = 0;
+   const uint64_t *m_deck_offsets = nullptr;
+   const uint32_t *m_card_ids = nullptr;
+   const uint32_t *m_counts = nullptr;
+   const uint64_t *m_failed = nullptr;
+};
+
+/**
+ * Bulk decoder for corpora of deck codes, one code per line. The text is split into line-aligned
+ * chunks which are decoded in parallel straight into columns, without a string or vector per code.
+ * Blank lines are skipped and do not count as decks.
+ */
+class CorpusDecoder {
+  public:
+   CorpusDecoder() = delete;
+
+   /**
+    * Decodes the memory-mapped file.
+    * @param path std::string,
+    *      the file of deck codes
+    * @param pool ThreadPool,
+    *      the pool to run on
+    * @return DeckBatch,
+    *      the decks in input order
+    */
+   static DeckBatch decode_file(
+      const std::string &path, ThreadPool &pool = ThreadPool::global());
+   /**
+    * Decodes the deck codes of the text.
+    * @param text std::string_view,
+    *      the deck codes, one per line
+    * @param pool ThreadPool,
+    *      the pool to run on
+    * @return DeckBatch,
+    *      the decks in input order
+    */
+   static DeckBatch decode(std::string_view text, ThreadPool &pool = ThreadPool::global());
+
+  private:
+   /// the chunk size the text is split into, rounded up to the next line end
+   static const size_t CHUNK_BYTES = 1 << 20;
+};
+
+#endif  // LORDECKENCODER_CORPUS_H
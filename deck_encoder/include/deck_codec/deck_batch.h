@@ -0,0 +1,164 @@
+
+#ifndef LORDECKENCODER_DECK_BATCH_H
+#define LORDECKENCODER_DECK_BATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "card_id.h"
+#include "thread_pool.h"
+
+/**
+ * Non-owning view on the cards of one deck held in columns. Iterating it yields CardIdCount values,
+ * which makes it a valid deck container for DeckCodec.
+ */
+class DeckSlice {
+  public:
+   using value_type = CardIdCount;
+
+   class const_iterator {
+     public:
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = CardIdCount;
+      using difference_type = std::ptrdiff_t;
+      using pointer = void;
+      using reference = CardIdCount;
+
+      const_iterator(const uint32_t *id, const uint32_t *count) : m_id(id), m_count(count) {}
+      CardIdCount operator*() const { return {CardId::from_value(*m_id), *m_count}; }
+      const_iterator &operator++()
+      {
+         m_id++;
+         m_count++;
+         return *this;
+      }
+      const_iterator operator++(int)
+      {
+         const_iterator prev = *this;
+         ++*this;
+         return prev;
+      }
+      bool operator==(const const_iterator &other) const { return m_id == other.m_id; }
+      bool operator!=(const const_iterator &other) const { return m_id != other.m_id; }
+
+     private:
+      const uint32_t *m_id;
+      const uint32_t *m_count;
+   };
+
+   DeckSlice(const uint32_t *card_ids, const uint32_t *counts, size_t size)
+       : m_card_ids(card_ids), m_counts(counts), m_size(size)
+   {
+   }
+
+   [[nodiscard]] size_t size() const { return m_size; }
+   [[nodiscard]] bool empty() const { return m_size == 0; }
+   [[nodiscard]] CardId id(size_t idx) const { return CardId::from_value(m_card_ids[idx]); }
+   [[nodiscard]] size_t count(size_t idx) const { return m_counts[idx]; }
+   [[nodiscard]] CardIdCount operator[](size_t idx) const { return {id(idx), count(idx)}; }
+   [[nodiscard]] const_iterator begin() const { return {m_card_ids, m_counts}; }
+   [[nodiscard]] const_iterator end() const { return {m_card_ids + m_size, m_counts + m_size}; }
+
+  private:
+   const uint32_t *m_card_ids;
+   const uint32_t *m_counts;
+   size_t m_size;
+};
+
+/**
+ * Many decks in structure-of-arrays form. Deck i holds the cards [deck_offsets[i],
+ * deck_offsets[i + 1]) of the card_ids and counts columns, 8 bytes per card in total. A code that
+ * failed to decode leaves an empty deck and is listed in failed.
+ *
+ * Indexing yields DeckSlice views, so that a batch is a valid container of decks for
+ * DeckCodec::encode_batch and single decks can be encoded with DeckCodec::encode.
+ */
+struct DeckBatch {
+   using value_type = DeckSlice;
+
+   /// n_decks + 1 offsets into the card columns
+   std::vector< uint64_t > deck_offsets{0};
+   /// the packed CardId values
+   std::vector< uint32_t > card_ids;
+   std::vector< uint32_t > counts;
+   /// the ascending indices of the decks whose code failed to decode
+   std::vector< uint64_t > failed;
+
+   [[nodiscard]] size_t size() const { return deck_offsets.size() - 1; }
+   [[nodiscard]] bool empty() const { return size() == 0; }
+   [[nodiscard]] size_t n_cards() const { return card_ids.size(); }
+   [[nodiscard]] DeckSlice operator[](size_t idx) const
+   {
+      return DeckSlice(
+         card_ids.data() + deck_offsets[idx],
+         counts.data() + deck_offsets[idx],
+         deck_offsets[idx + 1] - deck_offsets[idx]);
+   }
+
+   /// appends a card to the deck under construction, see finish_deck()
+   void add_card(CardId id, size_t count)
+   {
+      if(count > std::numeric_limits< uint32_t >::max()) {
+         throw std::invalid_argument("Card count out of range.");
+      }
+      card_ids.push_back(id.value());
+      counts.push_back(static_cast< uint32_t >(count));
+   }
+   /// closes the deck made of the cards added since the last finished deck
+   void finish_deck() { deck_offsets.push_back(card_ids.size()); }
+   /// drops the cards of the deck under construction and closes it as empty failed deck
+   void fail_deck()
+   {
+      card_ids.resize(deck_offsets.back());
+      counts.resize(deck_offsets.back());
+      failed.push_back(size());
+      finish_deck();
+   }
+   /// appends a whole deck of CardIdCount pairs
+   template < typename DeckContainer >
+   void push_back(const DeckContainer &deck)
+   {
+      for(const auto &[id, count] : deck) {
+         add_card(id, count);
+      }
+      finish_deck();
+   }
+   void clear()
+   {
+      deck_offsets.assign(1, 0);
+      card_ids.clear();
+      counts.clear();
+      failed.clear();
+   }
+
+   /**
+    * Appends the decks of the parts in order, copying the columns in parallel.
+    * @param parts std::vector<DeckBatch>,
+    *      the batches to append
+    * @param pool ThreadPool,
+    *      the pool to run on
+    */
+   void append(const std::vector< DeckBatch > &parts, ThreadPool &pool = ThreadPool::global());
+
+   /**
+    * Writes the columns to disk in the layout read by MappedColumns. The file holds the columns in
+    * native byte order behind a small header, each column aligned to 8 bytes.
+    * @param path std::string,
+    *      the file to write, throws std::runtime_error if it cannot be written
+    */
+   void write(const std::string &path) const;
+
+   /// the magic at the start of a column file
+   static constexpr char FILE_MAGIC[8] = {'L', 'O', 'R', 'C', 'O', 'L', 'S', '1'};
+   /// the magic followed by the number of decks, cards and failed decks
+   static constexpr size_t FILE_HEADER_BYTES = sizeof(FILE_MAGIC) + 3 * sizeof(uint64_t);
+   /// the bytes of the card id and count columns of a file, padded to a multiple of 8
+   static size_t file_card_bytes(size_t n_cards);
+};
+
+#endif  // LORDECKENCODER_DECK_BATCH_H
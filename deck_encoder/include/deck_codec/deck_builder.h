@@ -0,0 +1,117 @@
+
+#ifndef LORDECKENCODER_DECK_BUILDER_H
+#define LORDECKENCODER_DECK_BUILDER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "card_id.h"
+#include "region.h"
+
+/**
+ * A deck under construction which keeps its deck code current across single-card edits.
+ *
+ * The cards are held in the layout of the encoded byte stream: split by count into the 3-, 2- and
+ * 1-of buckets and the 4+ list, the buckets further split into their set-faction groups, which are
+ * kept sorted by size and code. An edit moves one card between these sorted structures in
+ * O(log n) and marks the groups it touched. code() re-emits the varints of the marked groups only
+ * and joins the cached group bytes before the base32 encoding.
+ *
+ * The code equals DeckCodec::encode(cards()). A builder is not thread-safe, each session is
+ * meant to own its builder.
+ */
+class DeckBuilder {
+  public:
+   DeckBuilder() = default;
+   /**
+    * Starts from the deck of a deck code. Cards listed more than once have their counts summed.
+    * @param deck_code std::string_view,
+    *      the code to start from, throws std::invalid_argument if it cannot be decoded
+    */
+   static DeckBuilder from_code(std::string_view deck_code);
+
+   /**
+    * Adds copies of the card.
+    * @param id CardId,
+    *      the card to add, throws std::invalid_argument if its region is unknown
+    * @param n size_t,
+    *      the number of copies to add
+    * @return size_t,
+    *      the new count of the card
+    */
+   size_t add(CardId id, size_t n = 1);
+   /// adds copies of the card given by its card code XXYYZZZ
+   size_t add(std::string_view card_code, size_t n = 1);
+   /**
+    * Removes copies of the card, at most as many as the deck holds.
+    * @return size_t,
+    *      the new count of the card, 0 once it left the deck
+    */
+   size_t remove(CardId id, size_t n = 1);
+   size_t remove(std::string_view card_code, size_t n = 1);
+   /// sets the count of the card, a count of 0 removes it
+   void set_count(CardId id, size_t count);
+   void set_count(std::string_view card_code, size_t count);
+   void clear();
+
+   /// the count of the card, 0 if it is not in the deck
+   [[nodiscard]] size_t count(CardId id) const;
+   /// the number of distinct cards
+   [[nodiscard]] size_t size() const { return m_counts.size(); }
+   [[nodiscard]] bool empty() const { return m_counts.empty(); }
+   /// the cards ordered by their packed id
+   [[nodiscard]] std::vector< CardIdCount > cards() const;
+
+   /**
+    * The deck code of the current deck, re-emitting only the groups changed since the last call.
+    * @return const std::string&,
+    *      the deck code, valid until the next edit
+    */
+   const std::string &code();
+
+  private:
+   /// the cards of one count sharing set and faction, with their encoded bytes
+   struct Group {
+      uint32_t set = 0;
+      Region region = Region::DEMACIA;
+      std::set< uint32_t > numbers;
+      /// the group's part of the byte stream: size, set, faction and the card numbers
+      std::string bytes;
+      bool dirty = true;
+   };
+   /// the groups of the cards of one count
+   struct Bucket {
+      /// by the code order of their set and faction
+      std::map< uint32_t, Group > groups;
+      /// the (size, key) pairs of the groups in stream order
+      std::set< std::pair< size_t, uint32_t > > order;
+   };
+
+   void _attach(CardId id, size_t count);
+   void _detach(CardId id, size_t count);
+   /// re-emits the bytes of the group
+   static void _emit(Group &group);
+   /// re-emits the bytes of the 4+ cards
+   void _emit_Nof();
+
+   std::map< CardId, size_t > m_counts;
+   /// the 1-, 2- and 3-ofs
+   std::array< Bucket, 3 > m_buckets;
+   /// the 4+ cards by code order
+   std::map< uint32_t, CardIdCount > m_Nofs;
+   std::string m_Nof_bytes;
+   bool m_Nofs_dirty = true;
+
+   std::string m_bytes;
+   std::string m_code;
+   bool m_code_valid = false;
+};
+
+#endif  // LORDECKENCODER_DECK_BUILDER_H
@@ -0,0 +1,204 @@
+
+#ifndef LORDECKENCODER_DECK_INDEX_H
+#define LORDECKENCODER_DECK_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "card_id.h"
+#include "corpus.h"
+#include "deck_batch.h"
+#include "region.h"
+#include "thread_pool.h"
+
+/**
+ * A set of deck indices within a corpus of a fixed number of decks, held as dense bitset. The set
+ * operations run over whole 64-bit words, 256 bits at a time with the AVX2 kernel.
+ */
+class DeckSet {
+  public:
+   DeckSet() = default;
+   /// the empty set within a corpus of n_decks decks
+   explicit DeckSet(size_t n_decks) : m_words((n_decks + 63) / 64), m_n_decks(n_decks) {}
+
+   /// the number of decks of the corpus
+   [[nodiscard]] size_t universe() const { return m_n_decks; }
+   /// the number of decks in the set
+   [[nodiscard]] size_t count() const;
+   [[nodiscard]] bool empty() const { return count() == 0; }
+   [[nodiscard]] bool contains(size_t deck) const
+   {
+      return (m_words[deck / 64] >> (deck % 64)) & 1U;
+   }
+   void insert(size_t deck) { m_words[deck / 64] |= uint64_t(1) << (deck % 64); }
+   /// the indices of the decks in the set, ascending
+   [[nodiscard]] std::vector< uint64_t > decks() const;
+   [[nodiscard]] const std::vector< uint64_t > &words() const { return m_words; }
+   [[nodiscard]] std::vector< uint64_t > &words() { return m_words; }
+
+   /// the set operations, both sets have to stem from the same corpus
+   DeckSet &operator&=(const DeckSet &other);
+   DeckSet &operator|=(const DeckSet &other);
+   /// removes the decks of the other set
+   DeckSet &subtract(const DeckSet &other);
+
+   bool operator==(const DeckSet &other) const
+   {
+      return m_n_decks == other.m_n_decks && m_words == other.m_words;
+   }
+   bool operator!=(const DeckSet &other) const { return not(*this == other); }
+
+  private:
+   std::vector< uint64_t > m_words;
+   size_t m_n_decks = 0;
+};
+
+/**
+ * A query on the decks of a DeckIndex, composed from card and region predicates with & (and),
+ * | (or) and ~ (not):
+ *      DeckQuery::card("01SI015", 3) & DeckQuery::region(Region::TARGON)
+ * Queries are cheap to copy, their terms are shared.
+ */
+class DeckQuery {
+  public:
+   /**
+    * The decks holding the card with a count in [min_count, max_count].
+    * @param id CardId,
+    *      the card to look for
+    * @param min_count size_t,
+    *      the minimum number of copies, at least 1
+    * @param max_count size_t,
+    *      the maximum number of copies
+    */
+   static DeckQuery card(
+      CardId id, size_t min_count = 1, size_t max_count = std::numeric_limits< size_t >::max());
+   /// the decks holding the card given by its card code, throws std::invalid_argument if malformed
+   static DeckQuery card(
+      std::string_view card_code,
+      size_t min_count = 1,
+      size_t max_count = std::numeric_limits< size_t >::max());
+   /// the decks holding any card of the region
+   static DeckQuery region(Region region);
+   /// all decks whose code could be decoded
+   static DeckQuery all();
+
+   friend DeckQuery operator&(const DeckQuery &q1, const DeckQuery &q2);
+   friend DeckQuery operator|(const DeckQuery &q1, const DeckQuery &q2);
+   friend DeckQuery operator~(const DeckQuery &query);
+
+  private:
+   friend class DeckIndex;
+
+   enum class Op { ALL, CARD, REGION, AND, OR, NOT };
+   struct Term {
+      Op op = Op::ALL;
+      CardId id;
+      size_t min_count = 1;
+      size_t max_count = 0;
+      Region region = Region::DEMACIA;
+      std::vector< DeckQuery > operands;
+   };
+
+   explicit DeckQuery(Term term) : m_term(std::make_shared< const Term >(std::move(term))) {}
+   static DeckQuery _combine(Op op, const DeckQuery &q1, const DeckQuery &q2);
+
+   std::shared_ptr< const Term > m_term;
+};
+
+/**
+ * Inverted index over a corpus of decoded decks, answering DeckQuery without decoding a code.
+ *
+ * Every card and count pair, every region and the set of decoded decks map to a posting list of the
+ * deck indices holding them. Like roaring bitmaps, a posting list is split into containers of
+ * 2^16 decks, each either a sorted array of the low 16 bits of its decks or, above 4096 decks, a
+ * bitmap of 1024 words. A query expands the postings of its terms into DeckSets and combines them
+ * with word-wise and, or and and-not.
+ *
+ * The index lives in a single flat buffer in its file layout, so that write() dumps it as it is and
+ * load() maps the file and is ready for queries after checking its header.
+ */
+class DeckIndex {
+  public:
+   DeckIndex() = default;
+   // the table views point into the buffer or mapping, which move along without reallocating
+   DeckIndex(const DeckIndex &) = delete;
+   DeckIndex &operator=(const DeckIndex &) = delete;
+   DeckIndex(DeckIndex &&) noexcept = default;
+   DeckIndex &operator=(DeckIndex &&) noexcept = default;
+
+   /**
+    * Builds the index of the decks in parallel. Each task collects the postings of a slice of a
+    * range of 2^16 decks, as small as 4096 decks if there are few ranges for the pool. The slices
+    * of a range are then merged into its containers.
+    * @param decks DeckBatch,
+    *      the decks to index, its failed decks are left out of all postings
+    * @param pool ThreadPool,
+    *      the pool to run on
+    */
+   static DeckIndex build(const DeckBatch &decks, ThreadPool &pool = ThreadPool::global());
+   /// builds the index of the decks of a mapped column file
+   static DeckIndex build(const MappedColumns &decks, ThreadPool &pool = ThreadPool::global());
+   /**
+    * Maps an index written by write().
+    * @param path std::string,
+    *      the index file, throws std::runtime_error if it is no index file or was cut short
+    */
+   static DeckIndex load(const std::string &path);
+   /// writes the index to disk, throws std::runtime_error if the file cannot be written
+   void write(const std::string &path) const;
+
+   /// the number of decks of the corpus, including those whose code failed to decode
+   [[nodiscard]] size_t size() const { return m_n_decks; }
+   /// the number of posting lists
+   [[nodiscard]] size_t n_postings() const { return m_n_keys; }
+   /// the size of the index in bytes, equal to its file size
+   [[nodiscard]] size_t byte_size() const { return m_size; }
+
+   /**
+    * Evaluates the query.
+    * @param query DeckQuery,
+    *      the query to evaluate
+    * @return DeckSet,
+    *      the matching decks
+    */
+   [[nodiscard]] DeckSet query(const DeckQuery &query) const;
+   /// the number of decks matching the query
+   [[nodiscard]] size_t count(const DeckQuery &query) const { return this->query(query).count(); }
+
+  private:
+   template < typename Decks >
+   static DeckIndex _build(
+      const Decks &decks, const uint64_t *failed, size_t n_failed, ThreadPool &pool);
+   /// points the table views into the buffer, throws std::runtime_error if it is malformed
+   void _attach(const char *data, size_t size);
+   /// adds the decks of the postings of the keys in [first_key, last_key] to the set
+   void _add_postings(uint64_t first_key, uint64_t last_key, DeckSet &decks) const;
+   DeckSet _evaluate(const DeckQuery &query) const;
+
+   /// the buffer of a built index
+   std::vector< char > m_buffer;
+   /// the mapping of a loaded index
+   std::optional< MappedFile > m_file;
+   const char *m_data = nullptr;
+   size_t m_size = 0;
+
+   size_t m_n_decks = 0;
+   size_t m_n_keys = 0;
+   size_t m_n_containers = 0;
+   /// the sorted posting keys
+   const uint64_t *m_keys = nullptr;
+   /// the first container of each key, followed by the total number of containers
+   const uint64_t *m_key_starts = nullptr;
+   /// per container: the upper 16 bits of its decks << 32 | its cardinality, and its payload offset
+   const uint64_t *m_containers = nullptr;
+   const char *m_payload = nullptr;
+   size_t m_payload_size = 0;
+};
+
+#endif  // LORDECKENCODER_DECK_INDEX_H
@@ -0,0 +1,191 @@
+
+#ifndef LORDECKENCODER_DECK_STATS_H
+#define LORDECKENCODER_DECK_STATS_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "card_id.h"
+#include "corpus.h"
+#include "deck_batch.h"
+#include "region.h"
+#include "thread_pool.h"
+
+/// the number of decks playing a card and the copies they play in total
+struct CardStats {
+   CardId id;
+   uint64_t n_decks = 0;
+   uint64_t n_copies = 0;
+
+   /// the mean number of copies among the decks playing the card
+   [[nodiscard]] double average_copies() const
+   {
+      return n_decks == 0 ? 0.0 : static_cast< double >(n_copies) / static_cast< double >(n_decks);
+   }
+};
+
+/// the number of decks playing a card together with another one
+struct CoOccurrence {
+   CardId id;
+   uint64_t n_decks = 0;
+};
+
+/// the number of decks playing cards of both regions
+struct RegionPairCount {
+   Region first;
+   Region second;
+   uint64_t n_decks = 0;
+};
+
+/**
+ * Aggregates play rates, copy counts, card co-occurrences and region pairs over a stream of decks.
+ * A card counts once per deck, its copies summed even if a deck lists it more than once.
+ *
+ * The batch functions aggregate into one partial DeckStats per chunk of work, so that the hot path
+ * touches no shared state, and merge the partials pairwise in parallel once all are done. Within a
+ * partial, the per-card totals sit in a dense array addressed by a two-level table of set-faction
+ * group and card number, and the pair counts in an open addressing table keyed by both card ids.
+ */
+class DeckStats {
+  public:
+   /// adds a deck of CardIdCount pairs
+   template < typename DeckContainer >
+   void add_deck(const DeckContainer &deck);
+   /// decodes and adds a deck code, a code that fails to decode is only counted, see n_failed()
+   void add_code(std::string_view deck_code);
+   /**
+    * Decodes and adds a batch of deck codes in parallel. Call it once per chunk of a stream.
+    * @param codes CodeContainer,
+    *      the deck codes, a random access container of strings or string_views
+    * @param pool ThreadPool,
+    *      the pool to run on
+    */
+   template < typename CodeContainer >
+   void add_codes(const CodeContainer &codes, ThreadPool &pool = ThreadPool::global());
+   /// adds the decks of the batch in parallel, its failed decks are only counted
+   void add_decks(const DeckBatch &decks, ThreadPool &pool = ThreadPool::global());
+   /// adds the decks of a mapped column file in parallel
+   void add_decks(const MappedColumns &decks, ThreadPool &pool = ThreadPool::global());
+   /// adds the aggregates of another DeckStats
+   void merge(const DeckStats &other);
+   void clear() { *this = DeckStats(); }
+
+   /// the number of decks added, not counting codes that failed to decode
+   [[nodiscard]] uint64_t n_decks() const { return m_n_decks; }
+   [[nodiscard]] uint64_t n_failed() const { return m_n_failed; }
+   /// the number of distinct cards seen
+   [[nodiscard]] size_t n_cards() const { return m_cards.size(); }
+   /// the number of distinct pairs of cards seen in one deck
+   [[nodiscard]] size_t n_pairs() const { return m_pairs.size(); }
+
+   /// the totals of the card, zero if it was never seen
+   [[nodiscard]] CardStats card(CardId id) const;
+   /// the totals of all cards seen, sorted by id
+   [[nodiscard]] std::vector< CardStats > cards() const;
+   /// the share of the decks playing the card
+   [[nodiscard]] double play_rate(CardId id) const;
+
+   /// the number of decks playing both cards, or playing the card if both are the same
+   [[nodiscard]] uint64_t co_occurrences(CardId id1, CardId id2) const;
+   /**
+    * The cards played most often together with a card.
+    * @param id CardId,
+    *      the card
+    * @param k size_t,
+    *      the maximum number of cards to return
+    * @return std::vector<CoOccurrence>,
+    *      the cards by number of decks descending, ties by id ascending
+    */
+   [[nodiscard]] std::vector< CoOccurrence > top_co_occurring(CardId id, size_t k) const;
+   /// the top k co-occurring cards of every card seen, sorted by card id, found in one pass
+   [[nodiscard]] std::vector< std::pair< CardId, std::vector< CoOccurrence > > > top_co_occurring(
+      size_t k) const;
+
+   /// the number of decks playing cards of both regions, or of the region if both are the same
+   [[nodiscard]] uint64_t region_pair(Region region1, Region region2) const;
+   /// the pairs of distinct regions played together, by number of decks descending
+   [[nodiscard]] std::vector< RegionPairCount > region_pairs() const;
+
+  private:
+   static constexpr uint32_t NO_SLOT = 0xFFFFFFFF;
+   static constexpr size_t N_REGIONS = REGION_INFO.size();
+
+   /**
+    * Open addressing table with linear probing of the decks per pair of cards, keyed by
+    * id1 << 32 | id2 with id1 < id2. The key of two equal ids never occurs and marks empty slots.
+    */
+   class PairCounts {
+     public:
+      static constexpr uint64_t EMPTY = ~uint64_t(0);
+
+      void add(uint64_t key, uint64_t n);
+      [[nodiscard]] uint64_t get(uint64_t key) const;
+      [[nodiscard]] size_t size() const { return m_size; }
+      [[nodiscard]] const std::vector< uint64_t > &keys() const { return m_keys; }
+      [[nodiscard]] const std::vector< uint64_t > &counts() const { return m_counts; }
+
+     private:
+      [[nodiscard]] size_t _find(uint64_t key) const;
+      void _grow();
+
+      std::vector< uint64_t > m_keys;
+      std::vector< uint64_t > m_counts;
+      size_t m_size = 0;
+   };
+
+   /// adds a deck, sorting its cards by id
+   void _add_sorted(std::vector< CardIdCount > &cards);
+   /// the slot of the card in the dense arrays, which is added if new
+   uint32_t _slot(CardId id);
+   [[nodiscard]] uint32_t _find_slot(CardId id) const;
+   /// merges the partials pairwise in parallel and then into this
+   void _merge_parts(std::vector< DeckStats > &parts, ThreadPool &pool);
+   template < typename Decks >
+   void _add_decks(const Decks &decks, const uint64_t *failed, size_t n_failed, ThreadPool &pool);
+
+   uint64_t m_n_decks = 0;
+   uint64_t m_n_failed = 0;
+   /// per set-faction group: the index of its table of card slots in m_group_slots, or NO_SLOT
+   std::vector< uint32_t > m_group_index;
+   /// per group: the slot of each card number, or NO_SLOT
+   std::vector< std::vector< uint32_t > > m_group_slots;
+   /// the dense per-card totals
+   std::vector< CardStats > m_cards;
+   PairCounts m_pairs;
+   /// the decks per pair of regions, region1 <= region2, in row-major order
+   std::array< uint64_t, N_REGIONS * N_REGIONS > m_region_pairs{};
+};
+
+template < typename DeckContainer >
+void DeckStats::add_deck(const DeckContainer &deck)
+{
+   thread_local std::vector< CardIdCount > cards;
+   cards.clear();
+   for(const auto &[id, count] : deck) {
+      cards.emplace_back(id, count);
+   }
+   _add_sorted(cards);
+}
+
+template < typename CodeContainer >
+void DeckStats::add_codes(const CodeContainer &codes, ThreadPool &pool)
+{
+   // a few partials per worker for balance, each aggregated by a single task
+   size_t n_parts = std::min(codes.size(), std::max(pool.size(), size_t(1)) * 4);
+   std::vector< DeckStats > parts(n_parts);
+   pool.parallel_for(n_parts, 1, [&](size_t begin, size_t end) {
+      for(size_t p = begin; p < end; p++) {
+         for(size_t i = p * codes.size() / n_parts; i < (p + 1) * codes.size() / n_parts; i++) {
+            parts[p].add_code(std::string_view(codes[i]));
+         }
+      }
+   });
+   _merge_parts(parts, pool);
+}
+
+#endif  // LORDECKENCODER_DECK_STATS_H
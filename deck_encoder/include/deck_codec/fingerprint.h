@@ -0,0 +1,85 @@
+
+#ifndef LORDECKENCODER_FINGERPRINT_H
+#define LORDECKENCODER_FINGERPRINT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include "card_id.h"
+
+/**
+ * 128-bit hash of the contents of a deck. It depends only on the multiset of (card, count) pairs,
+ * not on the formatting of a code or the order of its groups and cards. The lower word serves as
+ * 64-bit fingerprint on its own.
+ */
+struct Fingerprint {
+   uint64_t low = 0;
+   uint64_t high = 0;
+
+   /// the 64-bit fingerprint
+   [[nodiscard]] constexpr uint64_t value() const { return low; }
+
+   constexpr bool operator==(const Fingerprint &other) const
+   {
+      return low == other.low && high == other.high;
+   }
+   constexpr bool operator!=(const Fingerprint &other) const { return not(*this == other); }
+   constexpr bool operator<(const Fingerprint &other) const
+   {
+      return low < other.low || (low == other.low && high < other.high);
+   }
+};
+
+/**
+ * Accumulates the fingerprint of a deck card by card. Every card is hashed on its own with two
+ * independently seeded mixers and the hashes are summed, which makes the result independent of the
+ * order in which the cards are added.
+ */
+class FingerprintBuilder {
+  public:
+   constexpr void add(CardId id, size_t count)
+   {
+      uint64_t key = (uint64_t(id.value()) << 32U) ^ uint64_t(count);
+      m_low += _mix(key ^ LOW_SEED);
+      m_high += _mix(key ^ HIGH_SEED);
+      m_n_cards++;
+   }
+
+   [[nodiscard]] constexpr Fingerprint finish() const
+   {
+      // the finalization spreads the sums over all bits and folds in the number of cards
+      uint64_t low = _mix(m_low ^ _mix(m_n_cards));
+      return {low, _mix(m_high + low)};
+   }
+
+  private:
+   static constexpr uint64_t LOW_SEED = 0x9E3779B97F4A7C15ULL;
+   static constexpr uint64_t HIGH_SEED = 0xC2B2AE3D27D4EB4FULL;
+
+   /// the finalizer of splitmix64, a bijection with full avalanche
+   static constexpr uint64_t _mix(uint64_t x)
+   {
+      x = (x ^ (x >> 30U)) * 0xBF58476D1CE4E5B9ULL;
+      x = (x ^ (x >> 27U)) * 0x94D049BB133111EBULL;
+      return x ^ (x >> 31U);
+   }
+
+   uint64_t m_low = 0;
+   uint64_t m_high = 0;
+   uint64_t m_n_cards = 0;
+};
+
+namespace std {
+
+template <>
+struct hash< Fingerprint > {
+   size_t operator()(const Fingerprint &fingerprint) const noexcept
+   {
+      return static_cast< size_t >(fingerprint.value());
+   }
+};
+
+}  // namespace std
+
+#endif  // LORDECKENCODER_FINGERPRINT_H
@@ -0,0 +1,191 @@
+
+#ifndef LORDECKENCODER_INLINE_DECK_H
+#define LORDECKENCODER_INLINE_DECK_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <stdexcept>
+
+#include "card_id.h"
+
+/**
+ * A deck of at most N cards held inline in fixed-size arrays of packed card ids and 32-bit counts.
+ * It never allocates and is trivially copyable, so that it can be passed between threads or placed
+ * in shared memory as is, and it can be built, decoded and encoded in constant expressions.
+ * Iterating it yields CardIdCount values, which makes it a valid deck container for DeckCodec.
+ *
+ * push_back appends in any order. The sorted helpers keep the cards ordered by id instead and merge
+ * the counts of equal cards; they expect the deck to be sorted, see sort().
+ */
+template < size_t N >
+class InlineDeck {
+  public:
+   using value_type = CardIdCount;
+
+   class const_iterator {
+     public:
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = CardIdCount;
+      using difference_type = std::ptrdiff_t;
+      using pointer = void;
+      using reference = CardIdCount;
+
+      constexpr const_iterator(const InlineDeck *deck, size_t idx) : m_deck(deck), m_idx(idx) {}
+      constexpr CardIdCount operator*() const { return (*m_deck)[m_idx]; }
+      constexpr const_iterator &operator++()
+      {
+         m_idx++;
+         return *this;
+      }
+      constexpr const_iterator operator++(int)
+      {
+         const_iterator prev = *this;
+         m_idx++;
+         return prev;
+      }
+      constexpr bool operator==(const const_iterator &other) const { return m_idx == other.m_idx; }
+      constexpr bool operator!=(const const_iterator &other) const { return m_idx != other.m_idx; }
+
+     private:
+      const InlineDeck *m_deck;
+      size_t m_idx;
+   };
+
+   constexpr InlineDeck() = default;
+   constexpr InlineDeck(std::initializer_list< CardIdCount > cards)
+   {
+      for(const auto &card : cards) {
+         push_back(card.first, card.second);
+      }
+   }
+
+   /// appends the card, throws std::length_error if the deck is full
+   constexpr void push_back(CardId id, size_t count)
+   {
+      if(m_size == N) {
+         throw std::length_error("The deck exceeds its capacity.");
+      }
+      m_ids[m_size] = id;
+      m_counts[m_size] = _checked_count(count);
+      m_size++;
+   }
+   /// removes the card at the index, keeping the order of the others
+   constexpr void erase(size_t idx)
+   {
+      for(size_t i = idx + 1; i < m_size; i++) {
+         m_ids[i - 1] = m_ids[i];
+         m_counts[i - 1] = m_counts[i];
+      }
+      m_size--;
+   }
+   constexpr void clear() { m_size = 0; }
+
+   /// orders the cards by id, the precondition of the sorted helpers
+   constexpr void sort()
+   {
+      // insertion sort, as decks are small and std::sort cannot run in constant expressions
+      for(size_t i = 1; i < m_size; i++) {
+         CardId id = m_ids[i];
+         uint32_t count = m_counts[i];
+         size_t j = i;
+         for(; j > 0 && id < m_ids[j - 1]; j--) {
+            m_ids[j] = m_ids[j - 1];
+            m_counts[j] = m_counts[j - 1];
+         }
+         m_ids[j] = id;
+         m_counts[j] = count;
+      }
+   }
+   /// the index of the first card not ordered before the id in a sorted deck
+   [[nodiscard]] constexpr size_t lower_bound(CardId id) const
+   {
+      size_t first = 0;
+      size_t last = m_size;
+      while(first < last) {
+         size_t mid = first + (last - first) / 2;
+         if(m_ids[mid] < id) {
+            first = mid + 1;
+         } else {
+            last = mid;
+         }
+      }
+      return first;
+   }
+   /// the index of the card in a sorted deck, or size() if it is not contained
+   [[nodiscard]] constexpr size_t find(CardId id) const
+   {
+      size_t idx = lower_bound(id);
+      return idx < m_size && m_ids[idx] == id ? idx : m_size;
+   }
+   /**
+    * Adds copies of the card to a sorted deck: raises its count if it is contained already and
+    * inserts it at its sorted position otherwise. Throws std::length_error if the deck is full.
+    */
+   constexpr void insert_sorted(CardId id, size_t count)
+   {
+      size_t idx = lower_bound(id);
+      if(idx < m_size && m_ids[idx] == id) {
+         m_counts[idx] = _checked_count(m_counts[idx] + count);
+         return;
+      }
+      if(m_size == N) {
+         throw std::length_error("The deck exceeds its capacity.");
+      }
+      for(size_t i = m_size; i > idx; i--) {
+         m_ids[i] = m_ids[i - 1];
+         m_counts[i] = m_counts[i - 1];
+      }
+      m_ids[idx] = id;
+      m_counts[idx] = _checked_count(count);
+      m_size++;
+   }
+   /**
+    * Removes copies of the card from a sorted deck, and the card itself once none are left.
+    * @return size_t,
+    *      the number of copies removed, at most the count the deck held
+    */
+   constexpr size_t remove_sorted(CardId id, size_t count)
+   {
+      size_t idx = find(id);
+      if(idx == m_size) {
+         return 0;
+      }
+      if(count < m_counts[idx]) {
+         m_counts[idx] -= static_cast< uint32_t >(count);
+         return count;
+      }
+      size_t removed = m_counts[idx];
+      erase(idx);
+      return removed;
+   }
+
+   [[nodiscard]] constexpr size_t size() const { return m_size; }
+   [[nodiscard]] constexpr bool empty() const { return m_size == 0; }
+   [[nodiscard]] static constexpr size_t capacity() { return N; }
+   [[nodiscard]] constexpr CardId id(size_t idx) const { return m_ids[idx]; }
+   [[nodiscard]] constexpr size_t count(size_t idx) const { return m_counts[idx]; }
+   [[nodiscard]] constexpr CardIdCount operator[](size_t idx) const
+   {
+      return {m_ids[idx], m_counts[idx]};
+   }
+   [[nodiscard]] constexpr const_iterator begin() const { return {this, 0}; }
+   [[nodiscard]] constexpr const_iterator end() const { return {this, m_size}; }
+
+  private:
+   static constexpr uint32_t _checked_count(size_t count)
+   {
+      if(count > UINT32_MAX) {
+         throw std::invalid_argument("Card count out of range.");
+      }
+      return static_cast< uint32_t >(count);
+   }
+
+   std::array< CardId, N > m_ids{};
+   std::array< uint32_t, N > m_counts{};
+   size_t m_size = 0;
+};
+
+#endif  // LORDECKENCODER_INLINE_DECK_H
@@ -2,6 +2,11 @@
 #ifndef LORDECKECODER_REGION_H
 #define LORDECKECODER_REGION_H
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
 enum class Region {
    BILGEWATER = 0,
    DEMACIA,
@@ -11,7 +16,124 @@ enum class Region {
    PILTOVER_ZAUN,
    SHADOW_ISLES,
    SHURIMA,
-   TARGON
+   TARGON,
+   BANDLE_CITY,
+   RUNETERRA
+};
+
+/// the card code initials, the deck code id and the first format version of a region
+struct RegionInfo {
+   const char *initials;
+   uint32_t id;
+   uint32_t version;
 };
 
+/**
+ * The registry of all regions, indexed by the underlying value of Region. A new faction is added
+ * by appending it to the Region enum and to this table; the lookup tables below derive from it.
+ */
+inline constexpr std::array< RegionInfo, 11 > REGION_INFO = {{
+   {"BW", 6, 2},
+   {"DE", 0, 1},
+   {"FR", 1, 1},
+   {"IO", 2, 1},
+   {"NX", 3, 1},
+   {"PZ", 4, 1},
+   {"SI", 5, 1},
+   {"SH", 7, 3},
+   {"MT", 9, 2},
+   {"BC", 10, 4},
+   {"RU", 12, 5},
+}};
+
+/// marks the deck code ids and initials that no region is assigned to
+inline constexpr uint8_t NO_REGION = 0xFF;
+
+/**
+ * Builds the inverse of REGION_INFO: the underlying value of the Region for every deck code id, or
+ * NO_REGION if the id is not in use.
+ */
+constexpr std::array< uint8_t, 16 > build_region_by_id()
+{
+   std::array< uint8_t, 16 > table{};
+   for(auto &entry : table) {
+      entry = NO_REGION;
+   }
+   for(size_t region = 0; region < REGION_INFO.size(); region++) {
+      table[REGION_INFO[region].id] = static_cast< uint8_t >(region);
+   }
+   return table;
+}
+
+inline constexpr std::array< uint8_t, 16 > REGION_BY_ID = build_region_by_id();
+
+/// the perfect hash of two upper case letters into [0, 26 * 26)
+constexpr size_t initials_hash(char first, char second)
+{
+   return static_cast< size_t >(first - 'A') * 26 + static_cast< size_t >(second - 'A');
+}
+
+/**
+ * Builds the table of the underlying value of the Region for every pair of upper case initials, or
+ * NO_REGION if the initials are not in use.
+ */
+constexpr std::array< uint8_t, 26 * 26 > build_region_by_initials()
+{
+   std::array< uint8_t, 26 * 26 > table{};
+   for(auto &entry : table) {
+      entry = NO_REGION;
+   }
+   for(size_t region = 0; region < REGION_INFO.size(); region++) {
+      const char *initials = REGION_INFO[region].initials;
+      table[initials_hash(initials[0], initials[1])] = static_cast< uint8_t >(region);
+   }
+   return table;
+}
+
+inline constexpr std::array< uint8_t, 26 * 26 > REGION_BY_INITIALS = build_region_by_initials();
+
+/**
+ * Looks up the region of the two-letter initials.
+ * @param initials std::string_view,
+ *      the initials, e.g. "DE"
+ * @param region Region,
+ *      receives the found region
+ * @return bool,
+ *      whether the initials belong to a region
+ */
+constexpr bool region_from_initials(std::string_view initials, Region &region)
+{
+   if(initials.size() != 2 || initials[0] < 'A' || initials[0] > 'Z' || initials[1] < 'A'
+      || initials[1] > 'Z') {
+      return false;
+   }
+   uint8_t value = REGION_BY_INITIALS[initials_hash(initials[0], initials[1])];
+   if(value == NO_REGION) {
+      return false;
+   }
+   region = static_cast< Region >(value);
+   return true;
+}
+
+/**
+ * Builds the alphanumeric rank of every region's initials among all initials, indexed by the
+ * underlying value of the Region.
+ */
+constexpr std::array< uint32_t, REGION_INFO.size() > build_initials_rank()
+{
+   std::array< uint32_t, REGION_INFO.size() > ranks{};
+   for(size_t region = 0; region < REGION_INFO.size(); region++) {
+      const char *initials = REGION_INFO[region].initials;
+      for(const auto &other : REGION_INFO) {
+         if(other.initials[0] < initials[0]
+            || (other.initials[0] == initials[0] && other.initials[1] < initials[1])) {
+            ranks[region]++;
+         }
+      }
+   }
+   return ranks;
+}
+
+inline constexpr std::array< uint32_t, REGION_INFO.size() > INITIALS_RANK = build_initials_rank();
+
 #endif  // LORDECKECODER_REGION_H
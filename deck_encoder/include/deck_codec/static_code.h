@@ -0,0 +1,27 @@
+
+#ifndef LORDECKENCODER_STATIC_CODE_H
+#define LORDECKENCODER_STATIC_CODE_H
+
+#include <array>
+#include <cstddef>
+#include <string_view>
+
+/**
+ * A deck code of at most N characters held in a fixed-size array, the result of encoding a deck in
+ * a constant expression.
+ */
+template < size_t N >
+class StaticCode {
+  public:
+   [[nodiscard]] constexpr size_t size() const { return m_size; }
+   [[nodiscard]] constexpr char *data() { return m_chars.data(); }
+   [[nodiscard]] constexpr const char *data() const { return m_chars.data(); }
+   [[nodiscard]] constexpr std::string_view view() const { return {m_chars.data(), m_size}; }
+   constexpr void resize(size_t size) { m_size = size; }
+
+  private:
+   std::array< char, N > m_chars{};
+   size_t m_size = 0;
+};
+
+#endif  // LORDECKENCODER_STATIC_CODE_H
@@ -0,0 +1,83 @@
+
+#ifndef LORDECKENCODER_THREAD_POOL_H
+#define LORDECKENCODER_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A work-stealing thread pool for data-parallel loops. Every worker owns a queue of index ranges;
+ * it takes work from the back of its own queue and, once that runs dry, steals from the front of
+ * the other workers' queues. The thread calling parallel_for helps out until its loop is done, so
+ * nested loops cannot deadlock the pool.
+ */
+class ThreadPool {
+  public:
+   /**
+    * @param n_threads size_t,
+    *      the number of worker threads. With 0 workers all loops run on the calling thread.
+    */
+   explicit ThreadPool(size_t n_threads = std::thread::hardware_concurrency());
+   ~ThreadPool();
+
+   ThreadPool(const ThreadPool &) = delete;
+   ThreadPool &operator=(const ThreadPool &) = delete;
+
+   [[nodiscard]] size_t size() const { return m_workers.size(); }
+
+   /**
+    * Runs the task over the index range [0, n), split into chunks of at most grain indices, and
+    * blocks until every chunk is done. The first exception thrown by a task is rethrown here.
+    * @param n size_t,
+    *      the number of indices
+    * @param grain size_t,
+    *      the chunk size. 0 picks a size that yields a few chunks per worker.
+    * @param task std::function,
+    *      the callable receiving the [begin, end) index range of a chunk
+    */
+   void parallel_for(
+      size_t n, size_t grain, const std::function< void(size_t, size_t) > &task);
+
+   /// the process-wide pool sized to the hardware concurrency
+   static ThreadPool &global();
+
+  private:
+   struct Job {
+      const std::function< void(size_t, size_t) > *task;
+      std::atomic< size_t > remaining;
+      std::mutex mutex;
+      std::condition_variable done;
+      std::exception_ptr error;
+   };
+   struct Chunk {
+      Job *job;
+      size_t begin;
+      size_t end;
+   };
+   struct WorkQueue {
+      std::mutex mutex;
+      std::deque< Chunk > chunks;
+   };
+
+   void _worker_loop(size_t idx);
+   bool _try_pop(size_t idx, Chunk &chunk);
+   bool _try_steal(size_t idx, Chunk &chunk);
+   static void _run(const Chunk &chunk);
+
+   std::vector< std::unique_ptr< WorkQueue > > m_queues;
+   std::vector< std::thread > m_workers;
+   std::mutex m_mutex;
+   std::condition_variable m_wakeup;
+   std::atomic< size_t > m_queued{0};
+   bool m_stop = false;
+};
+
+#endif  // LORDECKENCODER_THREAD_POOL_H
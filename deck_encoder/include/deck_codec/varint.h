@@ -2,46 +2,154 @@
 #ifndef LORDECKENCODER_VARINT_H
 #define LORDECKENCODER_VARINT_H
 
-#include <algorithm>
+#include <array>
+#include <cstddef>
 #include <cstdint>
-#include <vector>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
 
 class Varint {
-   using byte = int8_t;
+   using byte = uint8_t;
    using ulong = uint64_t;
 
    static const byte AllButMSB = 0x7f;
    static const byte JustMSB = 0x80;
 
-   Varint() = default;
+  public:
+   static int pop_varint(std::string& bytes);
+   /**
+    * Reads the varint starting at the cursor position and advances the cursor past it. The bytes
+    * are neither copied nor erased. Usable in constant expressions.
+    * @param cursor const char*&,
+    *      the read position within the byte stream, moved behind the read varint
+    * @param end const char*,
+    *      the end of the byte stream
+    * @return uint64_t,
+    *      the value of the varint
+    */
+   static constexpr uint64_t read_varint(const char*& cursor, const char* end);
+   /**
+    * Writes the varint of the value to the output without allocating. Usable in constant
+    * expressions.
+    * @param value uint64_t,
+    *      the value to write
+    * @param out char*,
+    *      the output which has to hold at least MAX_BYTES bytes
+    * @return size_t,
+    *      the number of bytes written
+    */
+   static constexpr size_t write_varint(ulong value, char* out);
 
-   // allow any constructor that the single data member would take
-   template < typename... Args >
-   explicit Varint(Args&&... args) : m_data(std::forward< Args >(args)...)
+   /**
+    * Writes the varints of all values in the range to the output, such as the card numbers of a
+    * group. The length of every varint is computed up front from its bit width, so that each byte
+    * is stored without testing the remaining value.
+    * @param first, last InputIt,
+    *      the range of values to write
+    * @param out OutIt,
+    *      the output iterator, a char* has to hold MAX_BYTES bytes per value
+    * @param value_of Projection,
+    *      maps an element of the range to the uint64_t value to write
+    * @return OutIt,
+    *      the output iterator behind the written bytes
+    */
+   template < typename InputIt, typename OutIt, typename Projection >
+   static constexpr OutIt write_varints(
+      InputIt first, InputIt last, OutIt out, Projection value_of);
+   template < typename InputIt, typename OutIt >
+   static constexpr OutIt write_varints(InputIt first, InputIt last, OutIt out)
    {
+      auto value_of = [](auto value) { return static_cast< ulong >(value); };
+      return write_varints(first, last, out, value_of);
+   }
+   /// the number of bytes of the varint of the value
+   static constexpr size_t encoded_size(ulong value)
+   {
+      // 7 bits per byte, 0 takes a byte as well
+      return 1 + (_bit_width(value | 1U) - 1) / 7;
    }
 
-  public:
-   static int pop_varint(std::string& bytes);
-   static Varint from_int(ulong value);
-
-   [[nodiscard]] auto size() const { return m_data.size(); }
-   [[nodiscard]] auto begin() const { return m_data.begin(); }
-   [[nodiscard]] auto begin() { return m_data.begin(); }
-   [[nodiscard]] auto end() const { return m_data.end(); }
-   [[nodiscard]] auto end() { return m_data.end(); }
-   [[nodiscard]] inline auto& operator[](size_t n) { return m_data[n]; }
-   [[nodiscard]] inline auto& operator[](size_t n) const { return m_data[n]; }
-   [[nodiscard]] inline const auto& at(size_t idx) const { return m_data.at(idx); }
-   [[nodiscard]] inline auto& at(size_t idx) { return m_data.at(idx); }
-   template < typename IterType >
-   [[nodiscard]] inline auto erase(IterType position)
+   static constexpr size_t MAX_BYTES = 10;
+   /// the varint of the value, held inline without allocating
+   static constexpr Varint from_int(ulong value)
    {
-      return m_data.erase(position);
+      Varint vint;
+      byte* end = write_varints(&value, &value + 1, vint.m_data.data());
+      vint.m_size = static_cast< uint8_t >(end - vint.m_data.data());
+      return vint;
    }
 
+   [[nodiscard]] constexpr size_t size() const { return m_size; }
+   [[nodiscard]] constexpr const byte* begin() const { return m_data.data(); }
+   [[nodiscard]] constexpr byte* begin() { return m_data.data(); }
+   [[nodiscard]] constexpr const byte* end() const { return m_data.data() + m_size; }
+   [[nodiscard]] constexpr byte* end() { return m_data.data() + m_size; }
+   [[nodiscard]] constexpr byte& operator[](size_t n) { return m_data[n]; }
+   [[nodiscard]] constexpr const byte& operator[](size_t n) const { return m_data[n]; }
+   [[nodiscard]] const byte& at(size_t idx) const { return m_data.at(_checked(idx)); }
+   [[nodiscard]] byte& at(size_t idx) { return m_data.at(_checked(idx)); }
+
   private:
-   std::vector< byte > m_data;
+   static constexpr size_t _bit_width(ulong value)
+   {
+#if defined(__GNUC__) || defined(__clang__)
+      return value == 0 ? 0 : 64 - static_cast< size_t >(__builtin_clzll(value));
+#else
+      size_t width = 0;
+      for(; value != 0; value >>= 1U) {
+         width++;
+      }
+      return width;
+#endif
+   }
+   [[nodiscard]] size_t _checked(size_t idx) const
+   {
+      if(idx >= m_size) {
+         throw std::out_of_range("Varint byte index out of range.");
+      }
+      return idx;
+   }
+
+   std::array< byte, MAX_BYTES > m_data{};
+   uint8_t m_size = 0;
 };
 
+constexpr uint64_t Varint::read_varint(const char*& cursor, const char* end)
+{
+   ulong result = 0;
+   for(unsigned int shift = 0; cursor != end && shift < 64; shift += 7) {
+      auto current = static_cast< uint8_t >(*cursor++);
+      result |= static_cast< ulong >(current & AllButMSB) << shift;
+
+      if((current & 0x80U) == 0) {
+         return result;
+      }
+   }
+   throw std::invalid_argument("Byte array did not contain valid varints.");
+}
+
+constexpr size_t Varint::write_varint(ulong value, char* out)
+{
+   return static_cast< size_t >(write_varints(&value, &value + 1, out) - out);
+}
+
+template < typename InputIt, typename OutIt, typename Projection >
+constexpr OutIt Varint::write_varints(InputIt first, InputIt last, OutIt out, Projection value_of)
+{
+   // pointers are written with their own byte type, other iterators with char
+   using out_type =
+      std::conditional_t< std::is_pointer_v< OutIt >, std::remove_pointer_t< OutIt >, char >;
+   for(; first != last; ++first) {
+      auto value = static_cast< ulong >(value_of(*first));
+      size_t n_bytes = encoded_size(value);
+      for(size_t i = 1; i < n_bytes; i++) {
+         *out++ = static_cast< out_type >((value & AllButMSB) | JustMSB);
+         value >>= 7U;
+      }
+      *out++ = static_cast< out_type >(value);
+   }
+   return out;
+}
+
 #endif  // LORDECKENCODER_VARINT_H
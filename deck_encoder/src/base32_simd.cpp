@@ -0,0 +1,254 @@
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include "deck_codec/base32.h"
+
+#if(defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+   #define DECK_CODEC_X86_KERNELS
+   #include <immintrin.h>
+#endif
+
+namespace {
+
+#ifdef DECK_CODEC_X86_KERNELS
+
+/**
+ * Translates 16 base32 characters of either case into their 5-bit values. Returns false if any of
+ * them lies outside the alphabet.
+ */
+__attribute__((target("sse4.1"))) inline bool translate_sse41(__m128i chars, __m128i &values)
+{
+   // chars above 127 are negative as signed bytes and fail both range checks. Setting bit 5 folds
+   // upper onto lower case letters and leaves the digits as they are.
+   __m128i lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+   __m128i is_letter = _mm_and_si128(
+      _mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), lower));
+   __m128i is_digit = _mm_and_si128(
+      _mm_cmpgt_epi8(chars, _mm_set1_epi8('2' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('7' + 1), chars));
+   if(_mm_movemask_epi8(_mm_or_si128(is_letter, is_digit)) != 0xFFFF) {
+      return false;
+   }
+   // 'a'..'z' map to 0..25 and '2'..'7' to 26..31
+   __m128i offset = _mm_blendv_epi8(_mm_set1_epi8(26 - '2'), _mm_set1_epi8(-'a'), is_letter);
+   values = _mm_add_epi8(lower, offset);
+   return true;
+}
+
+/**
+ * Packs each group of 8 5-bit values of a 128-bit lane into its 40-bit big-endian value, held in
+ * the low 5 bytes of the corresponding 64-bit lane.
+ */
+__attribute__((target("sse4.1"))) inline __m128i pack_sse41(__m128i values)
+{
+   // merge neighbours: 2 x 5 bits -> 10 bits per 16-bit lane, then 2 x 10 bits -> 20 bits
+   __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi16(0x0120));
+   __m128i quads = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00010400));
+   // the 64-bit lane holds the leading 20 bits in its low and the trailing 20 bits in its high half
+   return _mm_or_si128(_mm_slli_epi64(quads, 20), _mm_srli_epi64(quads, 32));
+}
+
+/// shuffles the 40-bit values of both 64-bit lanes into 10 consecutive big-endian bytes
+__attribute__((target("sse4.1"))) inline __m128i to_bytes_sse41(__m128i packed)
+{
+   return _mm_shuffle_epi8(
+      packed, _mm_setr_epi8(4, 3, 2, 1, 0, 12, 11, 10, 9, 8, -1, -1, -1, -1, -1, -1));
+}
+
+__attribute__((target("sse4.1"))) size_t decode_blocks_sse41(
+   const char *code, size_t n_chars, char *out)
+{
+   size_t pos = 0;
+   for(; pos + 16 <= n_chars; pos += 16) {
+      __m128i values;
+      if(not translate_sse41(
+            _mm_loadu_si128(reinterpret_cast< const __m128i * >(code + pos)), values)) {
+         break;
+      }
+      alignas(16) char bytes[16];
+      _mm_store_si128(reinterpret_cast< __m128i * >(bytes), to_bytes_sse41(pack_sse41(values)));
+      std::memcpy(out, bytes, 10);
+      out += 10;
+   }
+   return pos;
+}
+
+__attribute__((target("avx2"))) size_t decode_blocks_avx2(
+   const char *code, size_t n_chars, char *out)
+{
+   const __m256i case_bit = _mm256_set1_epi8(0x20);
+   const __m256i letter_lo = _mm256_set1_epi8('a' - 1);
+   const __m256i letter_hi = _mm256_set1_epi8('z' + 1);
+   const __m256i digit_lo = _mm256_set1_epi8('2' - 1);
+   const __m256i digit_hi = _mm256_set1_epi8('7' + 1);
+   const __m256i letter_offset = _mm256_set1_epi8(-'a');
+   const __m256i digit_offset = _mm256_set1_epi8(26 - '2');
+   const __m256i shuffle = _mm256_setr_epi8(
+      4, 3, 2, 1, 0, 12, 11, 10, 9, 8, -1, -1, -1, -1, -1, -1,
+      4, 3, 2, 1, 0, 12, 11, 10, 9, 8, -1, -1, -1, -1, -1, -1);
+
+   size_t pos = 0;
+   for(; pos + 32 <= n_chars; pos += 32) {
+      __m256i chars = _mm256_loadu_si256(reinterpret_cast< const __m256i * >(code + pos));
+      __m256i lower = _mm256_or_si256(chars, case_bit);
+      __m256i is_letter = _mm256_and_si256(
+         _mm256_cmpgt_epi8(lower, letter_lo), _mm256_cmpgt_epi8(letter_hi, lower));
+      __m256i is_digit = _mm256_and_si256(
+         _mm256_cmpgt_epi8(chars, digit_lo), _mm256_cmpgt_epi8(digit_hi, chars));
+      if(_mm256_movemask_epi8(_mm256_or_si256(is_letter, is_digit)) != -1) {
+         break;
+      }
+      __m256i values = _mm256_add_epi8(
+         lower, _mm256_blendv_epi8(digit_offset, letter_offset, is_letter));
+
+      __m256i pairs = _mm256_maddubs_epi16(values, _mm256_set1_epi16(0x0120));
+      __m256i quads = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00010400));
+      __m256i packed = _mm256_or_si256(
+         _mm256_slli_epi64(quads, 20), _mm256_srli_epi64(quads, 32));
+
+      alignas(32) char bytes[32];
+      _mm256_store_si256(
+         reinterpret_cast< __m256i * >(bytes), _mm256_shuffle_epi8(packed, shuffle));
+      std::memcpy(out, bytes, 10);
+      std::memcpy(out + 10, bytes + 16, 10);
+      out += 20;
+   }
+   // finish a remaining half block with the 128-bit kernel
+   return pos + decode_blocks_sse41(code + pos, n_chars - pos, out);
+}
+
+/**
+ * The multipliers of _mm_mulhi_epu16 that shift each 16-bit byte window right so that the 5 bits
+ * of output character i end up in its lowest bits. The windows start at the bytes {0, 0, 1, 1, 2,
+ * 3, 3, 4} of a 5-byte block and the group of character i starts 5 * i bits into the block.
+ */
+#define DECK_CODEC_ENCODE_SHIFTS 1 << 5, 1 << 10, 1 << 7, 1 << 12, 1 << 9, 1 << 6, 1 << 11, 1 << 8
+
+/// translates 5-bit values into the characters 'A'..'Z' and '2'..'7'
+__attribute__((target("sse4.1"))) inline __m128i to_chars_sse41(__m128i values)
+{
+   __m128i is_digit = _mm_cmpgt_epi8(values, _mm_set1_epi8(25));
+   return _mm_add_epi8(
+      values, _mm_blendv_epi8(_mm_set1_epi8('A'), _mm_set1_epi8('2' - 26), is_digit));
+}
+
+__attribute__((target("sse4.1"))) size_t encode_blocks_sse41(
+   const char *text, size_t n_bytes, char *out)
+{
+   // gather the big-endian byte window of every character into a 16-bit lane, for the blocks
+   // starting at byte 0 and byte 5 of the load respectively
+   const __m128i windows_a = _mm_setr_epi8(1, 0, 1, 0, 2, 1, 2, 1, 3, 2, 4, 3, 4, 3, 5, 4);
+   const __m128i windows_b = _mm_setr_epi8(6, 5, 6, 5, 7, 6, 7, 6, 8, 7, 9, 8, 9, 8, 10, 9);
+   const __m128i shifts = _mm_setr_epi16(DECK_CODEC_ENCODE_SHIFTS);
+   const __m128i mask = _mm_set1_epi16(0x1F);
+
+   size_t pos = 0;
+   for(; pos + 16 <= n_bytes; pos += 10) {
+      __m128i bytes = _mm_loadu_si128(reinterpret_cast< const __m128i * >(text + pos));
+      __m128i a = _mm_and_si128(_mm_mulhi_epu16(_mm_shuffle_epi8(bytes, windows_a), shifts), mask);
+      __m128i b = _mm_and_si128(_mm_mulhi_epu16(_mm_shuffle_epi8(bytes, windows_b), shifts), mask);
+      _mm_storeu_si128(
+         reinterpret_cast< __m128i * >(out), to_chars_sse41(_mm_packus_epi16(a, b)));
+      out += 16;
+   }
+   return pos;
+}
+
+__attribute__((target("avx2"))) size_t encode_blocks_avx2(
+   const char *text, size_t n_bytes, char *out)
+{
+   const __m256i windows_a = _mm256_setr_epi8(
+      1, 0, 1, 0, 2, 1, 2, 1, 3, 2, 4, 3, 4, 3, 5, 4,
+      1, 0, 1, 0, 2, 1, 2, 1, 3, 2, 4, 3, 4, 3, 5, 4);
+   const __m256i windows_b = _mm256_setr_epi8(
+      6, 5, 6, 5, 7, 6, 7, 6, 8, 7, 9, 8, 9, 8, 10, 9,
+      6, 5, 6, 5, 7, 6, 7, 6, 8, 7, 9, 8, 9, 8, 10, 9);
+   const __m256i shifts = _mm256_setr_epi16(DECK_CODEC_ENCODE_SHIFTS, DECK_CODEC_ENCODE_SHIFTS);
+   const __m256i mask = _mm256_set1_epi16(0x1F);
+
+   size_t pos = 0;
+   // the upper lane covers bytes 10..25 of the block, so 26 bytes need to be readable
+   for(; pos + 26 <= n_bytes; pos += 20) {
+      __m256i bytes = _mm256_inserti128_si256(
+         _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast< const __m128i * >(text + pos))),
+         _mm_loadu_si128(reinterpret_cast< const __m128i * >(text + pos + 10)),
+         1);
+      __m256i a = _mm256_and_si256(
+         _mm256_mulhi_epu16(_mm256_shuffle_epi8(bytes, windows_a), shifts), mask);
+      __m256i b = _mm256_and_si256(
+         _mm256_mulhi_epu16(_mm256_shuffle_epi8(bytes, windows_b), shifts), mask);
+      __m256i values = _mm256_packus_epi16(a, b);
+      __m256i is_digit = _mm256_cmpgt_epi8(values, _mm256_set1_epi8(25));
+      __m256i chars = _mm256_add_epi8(
+         values,
+         _mm256_blendv_epi8(_mm256_set1_epi8('A'), _mm256_set1_epi8('2' - 26), is_digit));
+      _mm256_storeu_si256(reinterpret_cast< __m256i * >(out), chars);
+      out += 32;
+   }
+   return pos + encode_blocks_sse41(text + pos, n_bytes - pos, out);
+}
+
+#undef DECK_CODEC_ENCODE_SHIFTS
+
+#endif  // DECK_CODEC_X86_KERNELS
+
+base32::Kernel detect_kernel()
+{
+#ifdef DECK_CODEC_X86_KERNELS
+   __builtin_cpu_init();
+   if(__builtin_cpu_supports("avx2")) {
+      return base32::Kernel::AVX2;
+   }
+   if(__builtin_cpu_supports("sse4.1")) {
+      return base32::Kernel::SSE41;
+   }
+#endif
+   return base32::Kernel::SCALAR;
+}
+
+std::atomic< base32::Kernel > &active_kernel()
+{
+   static std::atomic< base32::Kernel > kernel{base32::best_kernel()};
+   return kernel;
+}
+
+}  // namespace
+
+base32::Kernel base32::best_kernel()
+{
+   static const Kernel best = detect_kernel();
+   return best;
+}
+
+void base32::use_kernel(Kernel kernel)
+{
+   active_kernel().store(std::min(kernel, best_kernel()), std::memory_order_relaxed);
+}
+
+base32::Kernel base32::kernel()
+{
+   return active_kernel().load(std::memory_order_relaxed);
+}
+
+size_t base32::_decode_blocks(const char *code, size_t n_chars, char *out)
+{
+   switch(kernel()) {
+#ifdef DECK_CODEC_X86_KERNELS
+      case Kernel::AVX2: return decode_blocks_avx2(code, n_chars, out);
+      case Kernel::SSE41: return decode_blocks_sse41(code, n_chars, out);
+#endif
+      default: return 0;
+   }
+}
+
+size_t base32::_encode_blocks(const char *text, size_t n_bytes, char *out)
+{
+   switch(kernel()) {
+#ifdef DECK_CODEC_X86_KERNELS
+      case Kernel::AVX2: return encode_blocks_avx2(text, n_bytes, out);
+      case Kernel::SSE41: return encode_blocks_sse41(text, n_bytes, out);
+#endif
+      default: return 0;
+   }
+}
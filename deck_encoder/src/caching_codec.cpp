@@ -0,0 +1,177 @@
+
+#include "deck_codec/caching_codec.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+
+/// the finalizer of splitmix64, spreads a std::hash of any width over all 64 bits
+constexpr uint64_t mix(uint64_t x)
+{
+   x = (x ^ (x >> 30U)) * 0xBF58476D1CE4E5B9ULL;
+   x = (x ^ (x >> 27U)) * 0x94D049BB133111EBULL;
+   return x ^ (x >> 31U);
+}
+
+}  // namespace
+
+PackedDeck::PackedDeck(const std::vector< CardIdCount > &cards)
+{
+   m_cards.reserve(cards.size());
+   for(const auto &[id, count] : cards) {
+      if(count > std::numeric_limits< uint32_t >::max()) {
+         throw std::invalid_argument("Card count out of range.");
+      }
+      m_cards.push_back((uint64_t(id.value()) << 32U) | count);
+   }
+}
+
+CachingDeckCodec::CachingDeckCodec(size_t capacity, size_t n_shards)
+{
+   capacity = std::max(capacity, size_t(1));
+   size_t n = 1;
+   while(n < n_shards) {
+      n *= 2;
+   }
+   // every shard holds at least one slot
+   while(n > capacity) {
+      n /= 2;
+   }
+   m_shard_mask = n - 1;
+   for(size_t i = 0; i < n; i++) {
+      // the remainder of the capacity goes to the first shards, so that the slots sum up to it
+      size_t n_slots = capacity / n + (i < capacity % n ? 1 : 0);
+      auto shard = std::make_unique< Shard >();
+      shard->slots = std::vector< Slot >(n_slots);
+      shard->index.reserve(n_slots);
+      m_shards.push_back(std::move(shard));
+   }
+}
+
+std::shared_ptr< const PackedDeck > CachingDeckCodec::get(std::string_view deck_code)
+{
+   // the normalized code of this thread, which stops allocating once it has warmed up
+   thread_local std::string buffer;
+   std::string_view key = _normalize(deck_code, buffer);
+   uint64_t hash = mix(std::hash< std::string_view >()(key));
+   // the lower bits pick the bucket within the shard's index, so the shard uses the upper ones
+   Shard &shard = *m_shards[(hash >> 48U) & m_shard_mask];
+
+   if(auto deck = _find(shard, key, hash)) {
+      shard.hits.fetch_add(1, std::memory_order_relaxed);
+      return deck;
+   }
+   shard.misses.fetch_add(1, std::memory_order_relaxed);
+   // decode outside of the lock, so that misses do not stall the hits on the same shard
+   auto deck = std::make_shared< const PackedDeck >(DeckCodec::decode< CardIdCount >(key));
+   return _insert(shard, key, hash, std::move(deck));
+}
+
+CachingDeckCodec::Stats CachingDeckCodec::stats() const
+{
+   Stats stats;
+   for(const auto &shard : m_shards) {
+      stats.hits += shard->hits.load(std::memory_order_relaxed);
+      stats.misses += shard->misses.load(std::memory_order_relaxed);
+      stats.evictions += shard->evictions.load(std::memory_order_relaxed);
+      std::shared_lock< std::shared_mutex > lock(shard->mutex);
+      stats.size += shard->n_used;
+   }
+   return stats;
+}
+
+void CachingDeckCodec::clear()
+{
+   for(auto &shard : m_shards) {
+      std::unique_lock< std::shared_mutex > lock(shard->mutex);
+      for(auto &slot : shard->slots) {
+         slot.key.clear();
+         slot.deck.reset();
+         slot.referenced.store(false, std::memory_order_relaxed);
+      }
+      shard->index.clear();
+      shard->n_used = 0;
+      shard->hand = 0;
+   }
+}
+
+std::string_view CachingDeckCodec::_normalize(std::string_view deck_code, std::string &buffer)
+{
+   auto is_space = [](char c) {
+      return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+   };
+   while(not deck_code.empty() && is_space(deck_code.front())) {
+      deck_code.remove_prefix(1);
+   }
+   // padding is only valid at the end, anywhere else it is kept so that decoding rejects it
+   while(not deck_code.empty() && (deck_code.back() == '=' || is_space(deck_code.back()))) {
+      deck_code.remove_suffix(1);
+   }
+   buffer.clear();
+   for(char c : deck_code) {
+      if(c == '-') {
+         continue;
+      }
+      buffer.push_back(c >= 'a' && c <= 'z' ? static_cast< char >(c - 'a' + 'A') : c);
+   }
+   return buffer;
+}
+
+std::shared_ptr< const PackedDeck > CachingDeckCodec::_find(
+   Shard &shard, std::string_view key, uint64_t hash)
+{
+   std::shared_lock< std::shared_mutex > lock(shard.mutex);
+   auto [first, last] = shard.index.equal_range(hash);
+   for(auto it = first; it != last; ++it) {
+      Slot &slot = shard.slots[it->second];
+      if(slot.key == key) {
+         if(not slot.referenced.load(std::memory_order_relaxed)) {
+            slot.referenced.store(true, std::memory_order_relaxed);
+         }
+         return slot.deck;
+      }
+   }
+   return nullptr;
+}
+
+std::shared_ptr< const PackedDeck > CachingDeckCodec::_insert(
+   Shard &shard, std::string_view key, uint64_t hash, std::shared_ptr< const PackedDeck > deck)
+{
+   std::unique_lock< std::shared_mutex > lock(shard.mutex);
+   auto [first, last] = shard.index.equal_range(hash);
+   for(auto it = first; it != last; ++it) {
+      if(shard.slots[it->second].key == key) {
+         return shard.slots[it->second].deck;
+      }
+   }
+
+   size_t idx;
+   if(shard.n_used < shard.slots.size()) {
+      idx = shard.n_used++;
+   } else {
+      // advance the hand past the referenced slots, clearing their bits on the way
+      while(shard.slots[shard.hand].referenced.exchange(false, std::memory_order_relaxed)) {
+         shard.hand = (shard.hand + 1) % shard.slots.size();
+      }
+      idx = shard.hand;
+      shard.hand = (shard.hand + 1) % shard.slots.size();
+      // drop the index entry of the evicted slot only, codes of the same hash stay
+      auto evicted = shard.index.find(shard.slots[idx].hash);
+      while(evicted->second != idx) {
+         ++evicted;
+      }
+      shard.index.erase(evicted);
+      shard.evictions.fetch_add(1, std::memory_order_relaxed);
+   }
+   Slot &slot = shard.slots[idx];
+   slot.key.assign(key.data(), key.size());
+   slot.hash = hash;
+   slot.deck = std::move(deck);
+   slot.referenced.store(false, std::memory_order_relaxed);
+   shard.index.emplace(hash, idx);
+   return slot.deck;
+}
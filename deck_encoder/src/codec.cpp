@@ -4,74 +4,308 @@
 #include "deck_codec/base32.h"
 #include "deck_codec/varint.h"
 
-const std::map< std::string, Region > &DeckCodec::str_to_region()
-{
-   static const std::map< std::string, Region > lookup = {
-      {"DE", Region::DEMACIA},
-      {"FR", Region::FRELJORD},
-      {"IO", Region::IONIA},
-      {"NX", Region::NOXUS},
-      {"PZ", Region::PILTOVER_ZAUN},
-      {"SI", Region::SHADOW_ISLES},
-      {"BW", Region::BILGEWATER},
-      {"SH", Region::SHURIMA},
-      {"MT", Region::TARGON}};
-   return lookup;
-}
-
-const std::map< Region, std::string > &DeckCodec::region_to_str()
-{
-   static const std::map< Region, std::string > lookup = {
-      {Region::DEMACIA, "DE"},
-      {Region::FRELJORD, "FR"},
-      {Region::IONIA, "IO"},
-      {Region::NOXUS, "NX"},
-      {Region::PILTOVER_ZAUN, "PZ"},
-      {Region::SHADOW_ISLES, "SI"},
-      {Region::BILGEWATER, "BW"},
-      {Region::SHURIMA, "SH"},
-      {Region::TARGON, "MT"}};
-   return lookup;
-}
-const std::map< size_t, Region > &DeckCodec::id_to_region()
-{
-   static const std::map< size_t, Region > lookup = {
-      {0, Region::DEMACIA},
-      {1, Region::FRELJORD},
-      {2, Region::IONIA},
-      {3, Region::NOXUS},
-      {4, Region::PILTOVER_ZAUN},
-      {5, Region::SHADOW_ISLES},
-      {6, Region::BILGEWATER},
-      {7, Region::SHURIMA},
-      {9, Region::TARGON},
+bool DeckCodec::_try_parse_card_id(std::string_view code, CardId &id)
+{
+   if(code.size() != CARD_CODE_LENGTH) {
+      return false;
+   }
+   auto parse_digits = [&](size_t pos, size_t len, uint32_t &value) {
+      value = 0;
+      for(size_t i = pos; i < pos + len; i++) {
+         if(code[i] < '0' || code[i] > '9') {
+            return false;
+         }
+         value = value * 10 + static_cast< uint32_t >(code[i] - '0');
+      }
+      return true;
    };
-   return lookup;
+   uint32_t set = 0;
+   uint32_t number = 0;
+   if(not parse_digits(0, 2, set) || not parse_digits(4, 3, number)) {
+      return false;
+   }
+   Region region{};
+   if(not region_from_initials(code.substr(2, 2), region)) {
+      return false;
+   }
+   id = CardId(set, region, number);
+   return true;
 }
-const std::map< Region, size_t > &DeckCodec::region_to_id()
+
+CardId DeckCodec::parse_card_id(std::string_view code)
 {
-   static const std::map< Region, size_t > lookup = {
-      {Region::DEMACIA, 0},
-      {Region::FRELJORD, 1},
-      {Region::IONIA, 2},
-      {Region::NOXUS, 3},
-      {Region::PILTOVER_ZAUN, 4},
-      {Region::SHADOW_ISLES, 5},
-      {Region::BILGEWATER, 6},
-      {Region::SHURIMA, 7},
-      {Region::TARGON, 9}};
-   return lookup;
+   CardId id;
+   if(not _try_parse_card_id(code, id)) {
+      throw std::invalid_argument("Invalid card code: " + std::string(code));
+   }
+   return id;
 }
 
-bool DeckCodec::_parseable_as_int(const std::string &s)
+std::tuple< int, Region, int > DeckCodec::parse_card_code(const std::string &code)
 {
-   return s.find_first_not_of("0123456789") == std::string::npos;
+   CardId id = parse_card_id(code);
+   return {static_cast< int >(id.set()), id.region(), static_cast< int >(id.number())};
 }
 
-std::tuple< int, Region, int > DeckCodec::parse_card_code(const std::string &code)
+std::string DeckCodec::card_code(CardId id)
+{
+   std::string code;
+   code.reserve(CARD_CODE_LENGTH);
+   // writes the number left-padded with '0' to the given width
+   auto append_number = [&](uint32_t value, size_t width) {
+      std::array< char, 10 > digits{};
+      size_t len = 0;
+      do {
+         digits[len++] = static_cast< char >('0' + value % 10);
+         value /= 10;
+      } while(value != 0);
+      if(width > len) {
+         code.append(width - len, '0');
+      }
+      while(len > 0) {
+         code.push_back(digits[--len]);
+      }
+   };
+   append_number(id.set(), 2);
+   code.append(REGION_INFO[static_cast< size_t >(id.region())].initials, 2);
+   append_number(id.number(), 3);
+   return code;
+}
+
+std::string DeckCodec::canonicalize(std::string_view deck_code)
+{
+   EncodeScratch &scratch = _scratch();
+   for(auto &bucket : scratch.by_count) {
+      bucket.clear();
+   }
+   _decode_ids(deck_code, [&](CardId id, size_t count) {
+      if(count < 1) {
+         throw std::invalid_argument("The provided code contains a card count of 0.");
+      }
+      scratch.by_count[std::min(count, size_t(4)) - 1].emplace_back(id, count);
+   });
+   return base32::encode(_encode_scratch(scratch));
+}
+
+Fingerprint DeckCodec::fingerprint(std::string_view deck_code)
+{
+   FingerprintBuilder builder;
+   _decode_ids(deck_code, [&builder](CardId id, size_t count) { builder.add(id, count); });
+   return builder.finish();
+}
+
+std::vector< CardDelta > DeckCodec::diff(std::string_view from_code, std::string_view to_code)
+{
+   thread_local std::vector< CardIdCount > from;
+   thread_local std::vector< CardIdCount > to;
+   _decode_sorted(from_code, from);
+   _decode_sorted(to_code, to);
+   std::vector< CardDelta > deltas;
+   deltas.reserve(from.size() + to.size());
+   _diff_sorted(from, to, deltas);
+   return deltas;
+}
+
+std::string DeckCodec::apply_patch(
+   std::string_view deck_code, const std::vector< CardDelta > &patch)
+{
+   thread_local std::vector< CardIdCount > cards;
+   thread_local std::vector< CardDelta > deltas;
+   thread_local std::vector< CardIdCount > patched;
+   _decode_sorted(deck_code, cards);
+   deltas.assign(patch.begin(), patch.end());
+   std::sort(deltas.begin(), deltas.end(), [](const auto &d1, const auto &d2) {
+      return d1.first < d2.first;
+   });
+
+   patched.clear();
+   auto card = cards.begin();
+   auto delta = deltas.begin();
+   while(card != cards.end() || delta != deltas.end()) {
+      // the next card id of either list, with its count and all of its deltas summed
+      CardId id = delta == deltas.end() || (card != cards.end() && card->first < delta->first)
+                     ? card->first
+                     : delta->first;
+      int64_t count = 0;
+      if(card != cards.end() && card->first == id) {
+         count = static_cast< int64_t >(card->second);
+         card++;
+      }
+      for(; delta != deltas.end() && delta->first == id; delta++) {
+         count += delta->second;
+      }
+      if(count < 0) {
+         throw std::invalid_argument(
+            "The patch removes more copies of " + card_code(id) + " than the deck holds.");
+      }
+      if(count > 0) {
+         patched.emplace_back(id, static_cast< size_t >(count));
+      }
+   }
+   return encode(patched);
+}
+
+void DeckCodec::_decode_sorted(std::string_view deck_code, std::vector< CardIdCount > &cards)
+{
+   cards.clear();
+   _decode_ids(deck_code, [&cards](CardId id, size_t count) { cards.emplace_back(id, count); });
+   std::sort(cards.begin(), cards.end(), [](const auto &c1, const auto &c2) {
+      return c1.first < c2.first;
+   });
+   // sum up the counts of cards listed more than once
+   auto last = cards.begin();
+   for(auto it = cards.begin(); it != cards.end(); it++) {
+      if(last != it && last->first == it->first) {
+         last->second += it->second;
+      } else if(last != it) {
+         *++last = *it;
+      }
+   }
+   if(not cards.empty()) {
+      cards.erase(std::next(last), cards.end());
+   }
+}
+
+void DeckCodec::_diff_sorted(
+   const std::vector< CardIdCount > &from,
+   const std::vector< CardIdCount > &to,
+   std::vector< CardDelta > &deltas)
+{
+   auto old_card = from.begin();
+   auto new_card = to.begin();
+   while(old_card != from.end() || new_card != to.end()) {
+      if(new_card == to.end() || (old_card != from.end() && old_card->first < new_card->first)) {
+         deltas.emplace_back(old_card->first, -static_cast< int64_t >(old_card->second));
+         old_card++;
+      } else if(old_card == from.end() || new_card->first < old_card->first) {
+         deltas.emplace_back(new_card->first, static_cast< int64_t >(new_card->second));
+         new_card++;
+      } else {
+         auto delta = static_cast< int64_t >(new_card->second)
+                      - static_cast< int64_t >(old_card->second);
+         if(delta != 0) {
+            deltas.emplace_back(new_card->first, delta);
+         }
+         old_card++;
+         new_card++;
+      }
+   }
+}
+
+DeckCodec::EncodeScratch &DeckCodec::_scratch()
+{
+   thread_local EncodeScratch scratch;
+   return scratch;
+}
+
+std::string_view DeckCodec::_encode_scratch(EncodeScratch &scratch)
+{
+   std::string &result = scratch.bytes;
+   // the version byte is settled once all regions are known
+   result.assign(1, '\0');
+   size_t version = VERSION;
+
+   // Encode the 3-ofs, 2-ofs and 1-ofs in that order
+   for(size_t count = 3; count > 0; count--) {
+      auto &group_Xofs = scratch.by_count[count - 1];
+      // build the lists of set and faction combinations within the groups of
+      // similar card
+      _group_cards(group_Xofs, scratch.group_bounds);
+      // to ensure that the same decklist in any order produces the same code,
+      // sort them
+      _sort_groups(scratch.group_bounds);
+      _encode_groups(result, group_Xofs, scratch.group_bounds);
+      for(const auto &[begin, end] : scratch.group_bounds) {
+         version = std::max(version, _version_of(group_Xofs[begin].first.region()));
+      }
+   }
+   auto &group_of_N = scratch.by_count[3];
+   _sort_by_code(group_of_N.begin(), group_of_N.end());
+   _encode_Nof(result, group_of_N);
+   for(const auto &card : group_of_N) {
+      version = std::max(version, _version_of(card.first.region()));
+   }
+   result[0] = static_cast< char >((FORMAT << 4) | version);  // i.e. 00010011 = 19 for version 3
+   return result;
+}
+
+void DeckCodec::_sort_groups(std::vector< std::pair< size_t, size_t > > &group_bounds)
+{
+   // the runs are in code order already, so their begin settles ties without looking at the cards
+   std::sort(group_bounds.begin(), group_bounds.end(), [](const auto &g1, const auto &g2) {
+      auto s1 = g1.second - g1.first;
+      auto s2 = g2.second - g2.first;
+      return (s1 < s2) || ((s1 == s2) && (g1.first < g2.first));
+   });
+}
+
+void DeckCodec::_group_cards(
+   std::vector< CardIdCount > &cards, std::vector< std::pair< size_t, size_t > > &group_bounds)
+{
+   group_bounds.clear();
+   _sort_by_code(cards.begin(), cards.end());
+   for(size_t begin = 0; begin < cards.size();) {
+      uint32_t group = cards[begin].first.group();
+      size_t end = begin + 1;
+      while(end < cards.size() && cards[end].first.group() == group) {
+         end++;
+      }
+      group_bounds.emplace_back(begin, end);
+      begin = end;
+   }
+}
+
+void DeckCodec::_encode_groups(
+   std::string &bytes,
+   const std::vector< CardIdCount > &cards,
+   const std::vector< std::pair< size_t, size_t > > &group_bounds)
+{
+   char *out = _grow(bytes, 1 + 3 * group_bounds.size() + cards.size());
+   out += Varint::write_varint(group_bounds.size(), out);
+
+   for(const auto &[begin, end] : group_bounds) {
+      // how many cards in current group?
+      out += Varint::write_varint(end - begin, out);
+
+      // determine this group by first declaring the set number and faction
+      CardId first = cards[begin].first;
+      out += Varint::write_varint(first.set(), out);
+      out += Varint::write_varint(_to_int(first.region()), out);
+
+      // now the cards within this group, as identified by the third section of
+      // card code only now,
+      auto first_card = cards.begin() + static_cast< std::ptrdiff_t >(begin);
+      auto last_card = cards.begin() + static_cast< std::ptrdiff_t >(end);
+      out = Varint::write_varints(
+         first_card, last_card, out, [](const CardIdCount &card) { return card.first.number(); });
+   }
+   bytes.resize(static_cast< size_t >(out - bytes.data()));
+}
+
+void DeckCodec::_encode_Nof(std::string &bytes, const std::vector< CardIdCount > &Nofs)
+{
+   char *out = _grow(bytes, 4 * Nofs.size());
+   for(const auto &[id, count] : Nofs) {
+      out += Varint::write_varint(count, out);
+      out += Varint::write_varint(id.set(), out);
+      out += Varint::write_varint(_to_int(id.region()), out);
+      out += Varint::write_varint(id.number(), out);
+   }
+   bytes.resize(static_cast< size_t >(out - bytes.data()));
+}
+
+char *DeckCodec::_grow(std::string &bytes, size_t n_varints)
+{
+   size_t size = bytes.size();
+   bytes.resize(size + n_varints * Varint::MAX_BYTES);
+   return bytes.data() + size;
+}
+
+void DeckCodec::_sort_by_code(
+   std::vector< CardIdCount >::iterator first, std::vector< CardIdCount >::iterator last)
 {
-   int set = std::stoi(code.substr(0, 2));
-   Region region = _to_region(code.substr(2, 2));
-   int number = std::stoi(code.substr(4, 3));
-   return {set, region, number};
+   // equal keys mean equal cards, so an unstable sort yields the same byte stream
+   std::sort(first, last, [](const auto &dc1, const auto &dc2) {
+      return _code_order(dc1.first) < _code_order(dc2.first);
+   });
 }
@@ -0,0 +1,191 @@
+
+#include "deck_codec/corpus.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "deck_codec/codec.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+   #define DECK_CODEC_HAS_MMAP
+   #include <fcntl.h>
+   #include <sys/mman.h>
+   #include <sys/stat.h>
+   #include <unistd.h>
+#endif
+
+namespace {
+
+void decode_chunk(std::string_view chunk, DeckBatch &batch)
+{
+   while(not chunk.empty()) {
+      size_t line_end = std::min(chunk.find('\n'), chunk.size());
+      std::string_view line = chunk.substr(0, line_end);
+      chunk.remove_prefix(std::min(line_end + 1, chunk.size()));
+      if(line.find_first_not_of(" \t\r\v\f") == std::string_view::npos) {
+         continue;
+      }
+      try {
+         DeckCodec::decode_each(line, [&](CardId id, size_t count) { batch.add_card(id, count); });
+         batch.finish_deck();
+      } catch(std::exception &) {
+         batch.fail_deck();
+      }
+   }
+}
+
+}  // namespace
+
+MappedFile::MappedFile(const std::string &path)
+{
+#ifdef DECK_CODEC_HAS_MMAP
+   int fd = ::open(path.c_str(), O_RDONLY);
+   if(fd < 0) {
+      throw std::runtime_error("Cannot open " + path);
+   }
+   struct stat info {};
+   if(::fstat(fd, &info) != 0) {
+      ::close(fd);
+      throw std::runtime_error("Cannot stat " + path);
+   }
+   m_size = static_cast< size_t >(info.st_size);
+   if(m_size > 0) {
+      void *mapping = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if(mapping == MAP_FAILED) {
+         ::close(fd);
+         throw std::runtime_error("Cannot map " + path);
+      }
+      ::madvise(mapping, m_size, MADV_SEQUENTIAL);
+      m_data = static_cast< const char * >(mapping);
+   }
+   ::close(fd);
+#else
+   std::ifstream file(path, std::ios::binary | std::ios::ate);
+   if(not file) {
+      throw std::runtime_error("Cannot open " + path);
+   }
+   m_fallback.resize(static_cast< size_t >(file.tellg()));
+   file.seekg(0);
+   file.read(m_fallback.data(), static_cast< std::streamsize >(m_fallback.size()));
+   m_data = m_fallback.data();
+   m_size = m_fallback.size();
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+   _release();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : m_data(other.m_data), m_size(other.m_size), m_fallback(std::move(other.m_fallback))
+{
+   other.m_data = nullptr;
+   other.m_size = 0;
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+{
+   if(this != &other) {
+      _release();
+      m_data = other.m_data;
+      m_size = other.m_size;
+      m_fallback = std::move(other.m_fallback);
+      other.m_data = nullptr;
+      other.m_size = 0;
+   }
+   return *this;
+}
+
+void MappedFile::_release()
+{
+#ifdef DECK_CODEC_HAS_MMAP
+   if(m_data != nullptr && m_fallback.empty()) {
+      ::munmap(const_cast< char * >(m_data), m_size);
+   }
+#endif
+   m_data = nullptr;
+   m_size = 0;
+   m_fallback.clear();
+}
+
+MappedColumns::MappedColumns(const std::string &path) : m_file(path)
+{
+   const char *data = m_file.data();
+   if(m_file.size() < DeckBatch::FILE_HEADER_BYTES
+      || std::memcmp(data, DeckBatch::FILE_MAGIC, sizeof(DeckBatch::FILE_MAGIC)) != 0) {
+      throw std::runtime_error(path + " is not a deck column file.");
+   }
+   uint64_t header[3];
+   std::memcpy(header, data + sizeof(DeckBatch::FILE_MAGIC), sizeof(header));
+   m_n_decks = header[0];
+   m_n_cards = header[1];
+   m_n_failed = header[2];
+
+   // no column holds more entries than the file has bytes, so that its size cannot overflow
+   if(m_n_decks >= m_file.size() || m_n_cards > m_file.size() || m_n_failed > m_file.size()) {
+      throw std::runtime_error(path + " does not match the size its header announces.");
+   }
+   size_t offsets_bytes = (m_n_decks + 1) * sizeof(uint64_t);
+   size_t cards_bytes = DeckBatch::file_card_bytes(m_n_cards);
+   if(m_file.size()
+      != DeckBatch::FILE_HEADER_BYTES + offsets_bytes + cards_bytes
+            + m_n_failed * sizeof(uint64_t)) {
+      throw std::runtime_error(path + " does not match the size its header announces.");
+   }
+   // the mapping is page aligned and every column starts at a multiple of 8 bytes
+   const char *cursor = data + DeckBatch::FILE_HEADER_BYTES;
+   m_deck_offsets = reinterpret_cast< const uint64_t * >(cursor);
+   cursor += offsets_bytes;
+   m_card_ids = reinterpret_cast< const uint32_t * >(cursor);
+   m_counts = m_card_ids + m_n_cards;
+   cursor += cards_bytes;
+   m_failed = reinterpret_cast< const uint64_t * >(cursor);
+
+   // the slices of operator[] and the failed decks have to lie within the columns
+   bool valid = m_deck_offsets[0] == 0 && m_deck_offsets[m_n_decks] == m_n_cards;
+   for(size_t d = 0; valid && d < m_n_decks; d++) {
+      valid = m_deck_offsets[d] <= m_deck_offsets[d + 1];
+   }
+   for(size_t f = 0; valid && f < m_n_failed; f++) {
+      valid = m_failed[f] < m_n_decks && (f == 0 || m_failed[f - 1] < m_failed[f]);
+   }
+   if(not valid) {
+      throw std::runtime_error(path + " holds deck offsets or failed decks out of order.");
+   }
+}
+
+DeckBatch CorpusDecoder::decode_file(const std::string &path, ThreadPool &pool)
+{
+   MappedFile file(path);
+   return decode(file.view(), pool);
+}
+
+DeckBatch CorpusDecoder::decode(std::string_view text, ThreadPool &pool)
+{
+   // a few chunks per worker for balance, each ending behind a line break
+   size_t target = std::clamp(
+      text.size() / (std::max(pool.size(), size_t(1)) * 4 + 1),
+      size_t(1) << 12,
+      size_t(CHUNK_BYTES));
+   std::vector< std::string_view > chunks;
+   while(not text.empty()) {
+      size_t end = text.find('\n', std::min(target, text.size()) - 1);
+      end = end == std::string_view::npos ? text.size() : end + 1;
+      chunks.push_back(text.substr(0, end));
+      text.remove_prefix(end);
+   }
+
+   std::vector< DeckBatch > parts(chunks.size());
+   pool.parallel_for(chunks.size(), 1, [&](size_t begin, size_t end) {
+      for(size_t c = begin; c < end; c++) {
+         decode_chunk(chunks[c], parts[c]);
+      }
+   });
+   DeckBatch batch;
+   batch.append(parts, pool);
+   return batch;
+}
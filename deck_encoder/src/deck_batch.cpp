@@ -0,0 +1,73 @@
+
+#include "deck_codec/deck_batch.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+namespace {
+
+constexpr size_t align8(size_t n)
+{
+   return (n + 7) / 8 * 8;
+}
+
+}  // namespace
+
+void DeckBatch::append(const std::vector< DeckBatch > &parts, ThreadPool &pool)
+{
+   // the position of every part within the merged columns
+   std::vector< size_t > deck_starts(parts.size() + 1, size());
+   std::vector< size_t > card_starts(parts.size() + 1, n_cards());
+   for(size_t p = 0; p < parts.size(); p++) {
+      deck_starts[p + 1] = deck_starts[p] + parts[p].size();
+      card_starts[p + 1] = card_starts[p] + parts[p].n_cards();
+      for(uint64_t local : parts[p].failed) {
+         failed.push_back(deck_starts[p] + local);
+      }
+   }
+   deck_offsets.resize(deck_starts.back() + 1);
+   card_ids.resize(card_starts.back());
+   counts.resize(card_starts.back());
+   pool.parallel_for(parts.size(), 1, [&](size_t begin, size_t end) {
+      for(size_t p = begin; p < end; p++) {
+         const DeckBatch &part = parts[p];
+         for(size_t d = 0; d < part.size(); d++) {
+            deck_offsets[deck_starts[p] + d + 1] = card_starts[p] + part.deck_offsets[d + 1];
+         }
+         auto card_start = static_cast< std::ptrdiff_t >(card_starts[p]);
+         std::copy(part.card_ids.begin(), part.card_ids.end(), card_ids.begin() + card_start);
+         std::copy(part.counts.begin(), part.counts.end(), counts.begin() + card_start);
+      }
+   });
+}
+
+size_t DeckBatch::file_card_bytes(size_t n_cards)
+{
+   return align8(2 * n_cards * sizeof(uint32_t));
+}
+
+void DeckBatch::write(const std::string &path) const
+{
+   std::FILE *file = std::fopen(path.c_str(), "wb");
+   if(file == nullptr) {
+      throw std::runtime_error("Cannot open " + path);
+   }
+   const uint64_t header[3] = {size(), card_ids.size(), failed.size()};
+   const char padding[8] = {};
+   size_t cards_bytes = 2 * card_ids.size() * sizeof(uint32_t);
+   size_t padding_bytes = file_card_bytes(card_ids.size()) - cards_bytes;
+   bool ok = std::fwrite(FILE_MAGIC, 1, sizeof(FILE_MAGIC), file) == sizeof(FILE_MAGIC)
+             && std::fwrite(header, sizeof(uint64_t), 3, file) == 3
+             && std::fwrite(deck_offsets.data(), sizeof(uint64_t), deck_offsets.size(), file)
+                   == deck_offsets.size()
+             && std::fwrite(card_ids.data(), sizeof(uint32_t), card_ids.size(), file)
+                   == card_ids.size()
+             && std::fwrite(counts.data(), sizeof(uint32_t), counts.size(), file) == counts.size()
+             && std::fwrite(padding, 1, padding_bytes, file) == padding_bytes
+             && std::fwrite(failed.data(), sizeof(uint64_t), failed.size(), file) == failed.size();
+   ok = std::fclose(file) == 0 && ok;
+   if(not ok) {
+      throw std::runtime_error("Cannot write " + path);
+   }
+}
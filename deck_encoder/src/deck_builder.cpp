@@ -0,0 +1,194 @@
+
+#include "deck_codec/deck_builder.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+#include "deck_codec/base32.h"
+#include "deck_codec/codec.h"
+#include "deck_codec/varint.h"
+
+DeckBuilder DeckBuilder::from_code(std::string_view deck_code)
+{
+   DeckBuilder builder;
+   DeckCodec::decode_each(deck_code, [&builder](CardId id, size_t count) {
+      builder.add(id, count);
+   });
+   return builder;
+}
+
+size_t DeckBuilder::add(CardId id, size_t n)
+{
+   size_t count = this->count(id) + n;
+   set_count(id, count);
+   return count;
+}
+
+size_t DeckBuilder::add(std::string_view card_code, size_t n)
+{
+   return add(DeckCodec::parse_card_id(card_code), n);
+}
+
+size_t DeckBuilder::remove(CardId id, size_t n)
+{
+   size_t count = this->count(id);
+   count -= std::min(count, n);
+   set_count(id, count);
+   return count;
+}
+
+size_t DeckBuilder::remove(std::string_view card_code, size_t n)
+{
+   return remove(DeckCodec::parse_card_id(card_code), n);
+}
+
+void DeckBuilder::set_count(CardId id, size_t count)
+{
+   if(not DeckCodec::_is_known(id.region())) {
+      throw std::invalid_argument("The provided card has an unknown region.");
+   }
+   auto it = m_counts.find(id);
+   size_t old_count = it == m_counts.end() ? 0 : it->second;
+   if(count == old_count) {
+      return;
+   }
+   if(old_count > 0) {
+      _detach(id, old_count);
+   }
+   if(count > 0) {
+      _attach(id, count);
+      m_counts.insert_or_assign(id, count);
+   } else {
+      m_counts.erase(it);
+   }
+   m_code_valid = false;
+}
+
+void DeckBuilder::set_count(std::string_view card_code, size_t count)
+{
+   set_count(DeckCodec::parse_card_id(card_code), count);
+}
+
+void DeckBuilder::clear()
+{
+   *this = DeckBuilder();
+}
+
+size_t DeckBuilder::count(CardId id) const
+{
+   auto it = m_counts.find(id);
+   return it == m_counts.end() ? 0 : it->second;
+}
+
+std::vector< CardIdCount > DeckBuilder::cards() const
+{
+   return {m_counts.begin(), m_counts.end()};
+}
+
+const std::string &DeckBuilder::code()
+{
+   if(m_code_valid) {
+      return m_code;
+   }
+   size_t version = DeckCodec::VERSION;
+   m_bytes.assign(1, '\0');
+   for(size_t count = 3; count > 0; count--) {
+      Bucket &bucket = m_buckets[count - 1];
+      std::array< char, Varint::MAX_BYTES > n_groups;
+      m_bytes.append(n_groups.data(), Varint::write_varint(bucket.order.size(), n_groups.data()));
+      for(const auto &[size, key] : bucket.order) {
+         Group &group = bucket.groups.at(key);
+         if(group.dirty) {
+            _emit(group);
+         }
+         m_bytes += group.bytes;
+         version = std::max(version, DeckCodec::_version_of(group.region));
+      }
+   }
+   if(m_Nofs_dirty) {
+      _emit_Nof();
+   }
+   m_bytes += m_Nof_bytes;
+   for(const auto &[key, card] : m_Nofs) {
+      version = std::max(version, DeckCodec::_version_of(card.first.region()));
+   }
+   m_bytes[0] = static_cast< char >((DeckCodec::FORMAT << 4) | version);
+
+   m_code.resize(base32::encoded_size(m_bytes.size()));
+   m_code.resize(base32::encode_to(m_bytes, m_code.data(), m_code.size()));
+   m_code_valid = true;
+   return m_code;
+}
+
+void DeckBuilder::_attach(CardId id, size_t count)
+{
+   uint32_t key = DeckCodec::_code_order(id);
+   if(count > 3) {
+      m_Nofs.emplace(key, CardIdCount{id, count});
+      m_Nofs_dirty = true;
+      return;
+   }
+   Bucket &bucket = m_buckets[count - 1];
+   uint32_t group_key = key >> 16U;
+   auto [it, inserted] = bucket.groups.try_emplace(group_key);
+   Group &group = it->second;
+   if(inserted) {
+      group.set = id.set();
+      group.region = id.region();
+   } else {
+      bucket.order.erase({group.numbers.size(), group_key});
+   }
+   group.numbers.insert(id.number());
+   group.dirty = true;
+   bucket.order.emplace(group.numbers.size(), group_key);
+}
+
+void DeckBuilder::_detach(CardId id, size_t count)
+{
+   uint32_t key = DeckCodec::_code_order(id);
+   if(count > 3) {
+      m_Nofs.erase(key);
+      m_Nofs_dirty = true;
+      return;
+   }
+   Bucket &bucket = m_buckets[count - 1];
+   uint32_t group_key = key >> 16U;
+   auto it = bucket.groups.find(group_key);
+   Group &group = it->second;
+   bucket.order.erase({group.numbers.size(), group_key});
+   group.numbers.erase(id.number());
+   if(group.numbers.empty()) {
+      bucket.groups.erase(it);
+      return;
+   }
+   group.dirty = true;
+   bucket.order.emplace(group.numbers.size(), group_key);
+}
+
+void DeckBuilder::_emit(Group &group)
+{
+   group.bytes.clear();
+   char *out = DeckCodec::_grow(group.bytes, 3 + group.numbers.size());
+   out += Varint::write_varint(group.numbers.size(), out);
+   out += Varint::write_varint(group.set, out);
+   out += Varint::write_varint(DeckCodec::_to_int(group.region), out);
+   out = Varint::write_varints(group.numbers.begin(), group.numbers.end(), out);
+   group.bytes.resize(static_cast< size_t >(out - group.bytes.data()));
+   group.dirty = false;
+}
+
+void DeckBuilder::_emit_Nof()
+{
+   m_Nof_bytes.clear();
+   char *out = DeckCodec::_grow(m_Nof_bytes, 4 * m_Nofs.size());
+   for(const auto &[key, card] : m_Nofs) {
+      const auto &[id, count] = card;
+      out += Varint::write_varint(count, out);
+      out += Varint::write_varint(id.set(), out);
+      out += Varint::write_varint(DeckCodec::_to_int(id.region()), out);
+      out += Varint::write_varint(id.number(), out);
+   }
+   m_Nof_bytes.resize(static_cast< size_t >(out - m_Nof_bytes.data()));
+   m_Nofs_dirty = false;
+}
@@ -0,0 +1,592 @@
+
+#include "deck_codec/deck_index.h"
+
+#include <algorithm>
+#include <bitset>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+#include "deck_codec/codec.h"
+
+#if(defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+   #define DECK_CODEC_X86_KERNELS
+   #include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr char INDEX_MAGIC[8] = {'L', 'O', 'R', 'I', 'N', 'D', 'X', '1'};
+/// the magic followed by the number of decks, keys and containers
+constexpr size_t INDEX_HEADER_BYTES = sizeof(INDEX_MAGIC) + 3 * sizeof(uint64_t);
+
+/// the decks of a container share the upper bits of their index
+constexpr size_t CONTAINER_BITS = 16;
+constexpr size_t CONTAINER_DECKS = size_t(1) << CONTAINER_BITS;
+constexpr size_t BITMAP_WORDS = CONTAINER_DECKS / 64;
+/// the fewest decks whose postings one task of the build collects
+constexpr size_t MIN_SLICE_DECKS = 4096;
+/// containers of more decks are stored as bitmap, which is then at most as large as the array
+constexpr size_t MAX_ARRAY_DECKS = 4096;
+
+/**
+ * The posting keys: the decoded decks, a region, or a card with its count. Keys sort by kind, the
+ * counts of one card are adjacent.
+ */
+constexpr uint64_t KEY_ALL = 0;
+constexpr uint64_t KEY_REGION = uint64_t(1) << 56U;
+constexpr uint64_t KEY_CARD = uint64_t(2) << 56U;
+/// counts saturate at 24 bits
+constexpr size_t MAX_KEY_COUNT = 0xFFFFFF;
+
+constexpr uint64_t region_key(Region region)
+{
+   return KEY_REGION | static_cast< uint64_t >(region);
+}
+
+constexpr uint64_t card_key(CardId id, size_t count)
+{
+   return KEY_CARD | (uint64_t(id.value()) << 24U) | std::min(count, MAX_KEY_COUNT);
+}
+
+static_assert(REGION_INFO.size() <= 32, "The regions of a deck are collected in 32-bit masks.");
+
+constexpr size_t align8(size_t n)
+{
+   return (n + 7) / 8 * 8;
+}
+
+size_t payload_bytes(size_t cardinality)
+{
+   return cardinality > MAX_ARRAY_DECKS ? BITMAP_WORDS * sizeof(uint64_t)
+                                        : align8(cardinality * sizeof(uint16_t));
+}
+
+/// a container of one key built from one range of 2^16 decks
+struct PartContainer {
+   uint64_t key = 0;
+   uint32_t cardinality = 0;
+   std::vector< uint64_t > payload;
+};
+
+enum class SetOp { AND, OR, AND_NOT };
+
+template < SetOp OP >
+constexpr uint64_t apply(uint64_t word, uint64_t other)
+{
+   if constexpr(OP == SetOp::AND) {
+      return word & other;
+   } else if constexpr(OP == SetOp::OR) {
+      return word | other;
+   } else {
+      return word & ~other;
+   }
+}
+
+template < SetOp OP >
+void combine_scalar(uint64_t *words, const uint64_t *other, size_t n)
+{
+   for(size_t i = 0; i < n; i++) {
+      words[i] = apply< OP >(words[i], other[i]);
+   }
+}
+
+#ifdef DECK_CODEC_X86_KERNELS
+
+template < SetOp OP >
+__attribute__((target("avx2"))) void combine_avx2(uint64_t *words, const uint64_t *other, size_t n)
+{
+   size_t i = 0;
+   for(; i + 4 <= n; i += 4) {
+      __m256i a = _mm256_loadu_si256(reinterpret_cast< const __m256i * >(words + i));
+      __m256i b = _mm256_loadu_si256(reinterpret_cast< const __m256i * >(other + i));
+      if constexpr(OP == SetOp::AND) {
+         a = _mm256_and_si256(a, b);
+      } else if constexpr(OP == SetOp::OR) {
+         a = _mm256_or_si256(a, b);
+      } else {
+         a = _mm256_andnot_si256(b, a);
+      }
+      _mm256_storeu_si256(reinterpret_cast< __m256i * >(words + i), a);
+   }
+   combine_scalar< OP >(words + i, other + i, n - i);
+}
+
+#endif  // DECK_CODEC_X86_KERNELS
+
+/// combines the words with the AVX2 kernel if the CPU supports it
+template < SetOp OP >
+void combine(uint64_t *words, const uint64_t *other, size_t n)
+{
+#ifdef DECK_CODEC_X86_KERNELS
+   static const bool has_avx2 = __builtin_cpu_supports("avx2");
+   if(has_avx2) {
+      combine_avx2< OP >(words, other, n);
+      return;
+   }
+#endif
+   combine_scalar< OP >(words, other, n);
+}
+
+size_t lowest_bit(uint64_t word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+   return static_cast< size_t >(__builtin_ctzll(word));
+#else
+   size_t bit = 0;
+   for(; (word & 1U) == 0; word >>= 1U) {
+      bit++;
+   }
+   return bit;
+#endif
+}
+
+}  // namespace
+
+size_t DeckSet::count() const
+{
+   size_t n = 0;
+   for(uint64_t word : m_words) {
+      n += std::bitset< 64 >(word).count();
+   }
+   return n;
+}
+
+std::vector< uint64_t > DeckSet::decks() const
+{
+   std::vector< uint64_t > result;
+   result.reserve(count());
+   for(size_t w = 0; w < m_words.size(); w++) {
+      for(uint64_t word = m_words[w]; word != 0; word &= word - 1) {
+         result.push_back(w * 64 + lowest_bit(word));
+      }
+   }
+   return result;
+}
+
+DeckSet &DeckSet::operator&=(const DeckSet &other)
+{
+   combine< SetOp::AND >(m_words.data(), other.m_words.data(), m_words.size());
+   return *this;
+}
+
+DeckSet &DeckSet::operator|=(const DeckSet &other)
+{
+   combine< SetOp::OR >(m_words.data(), other.m_words.data(), m_words.size());
+   return *this;
+}
+
+DeckSet &DeckSet::subtract(const DeckSet &other)
+{
+   combine< SetOp::AND_NOT >(m_words.data(), other.m_words.data(), m_words.size());
+   return *this;
+}
+
+DeckQuery DeckQuery::card(CardId id, size_t min_count, size_t max_count)
+{
+   Term term;
+   term.op = Op::CARD;
+   term.id = id;
+   term.min_count = std::max(min_count, size_t(1));
+   term.max_count = max_count;
+   return DeckQuery(std::move(term));
+}
+
+DeckQuery DeckQuery::card(std::string_view card_code, size_t min_count, size_t max_count)
+{
+   return card(DeckCodec::parse_card_id(card_code), min_count, max_count);
+}
+
+DeckQuery DeckQuery::region(Region region)
+{
+   Term term;
+   term.op = Op::REGION;
+   term.region = region;
+   return DeckQuery(std::move(term));
+}
+
+DeckQuery DeckQuery::all()
+{
+   return DeckQuery(Term());
+}
+
+DeckQuery operator&(const DeckQuery &q1, const DeckQuery &q2)
+{
+   return DeckQuery::_combine(DeckQuery::Op::AND, q1, q2);
+}
+
+DeckQuery operator|(const DeckQuery &q1, const DeckQuery &q2)
+{
+   return DeckQuery::_combine(DeckQuery::Op::OR, q1, q2);
+}
+
+DeckQuery operator~(const DeckQuery &query)
+{
+   DeckQuery::Term term;
+   term.op = DeckQuery::Op::NOT;
+   term.operands.push_back(query);
+   return DeckQuery(std::move(term));
+}
+
+DeckQuery DeckQuery::_combine(Op op, const DeckQuery &q1, const DeckQuery &q2)
+{
+   // chains of the same operation are flattened into a single term
+   Term term;
+   term.op = op;
+   for(const DeckQuery *query : {&q1, &q2}) {
+      if(query->m_term->op == op) {
+         const auto &operands = query->m_term->operands;
+         term.operands.insert(term.operands.end(), operands.begin(), operands.end());
+      } else {
+         term.operands.push_back(*query);
+      }
+   }
+   return DeckQuery(std::move(term));
+}
+
+DeckIndex DeckIndex::build(const DeckBatch &decks, ThreadPool &pool)
+{
+   return _build(decks, decks.failed.data(), decks.failed.size(), pool);
+}
+
+DeckIndex DeckIndex::build(const MappedColumns &decks, ThreadPool &pool)
+{
+   return _build(decks, decks.failed(), decks.n_failed(), pool);
+}
+
+template < typename Decks >
+DeckIndex DeckIndex::_build(
+   const Decks &decks, const uint64_t *failed, size_t n_failed, ThreadPool &pool)
+{
+   size_t n_decks = decks.size();
+   DeckSet failed_decks(n_decks);
+   for(size_t i = 0; i < n_failed; i++) {
+      failed_decks.insert(failed[i]);
+   }
+
+   // the container ranges are split into slices until there are a few tasks per worker
+   size_t n_tasks = std::max(pool.size(), size_t(1)) * 4;
+   size_t slice_decks = CONTAINER_DECKS;
+   while(slice_decks > MIN_SLICE_DECKS && (n_decks + slice_decks - 1) / slice_decks < n_tasks) {
+      slice_decks /= 2;
+   }
+   size_t slices_per_part = CONTAINER_DECKS / slice_decks;
+
+   // each slice collects its lists of low bits in parallel, sorted by key
+   using Postings = std::vector< std::pair< uint64_t, std::vector< uint16_t > > >;
+   size_t n_slices = (n_decks + slice_decks - 1) / slice_decks;
+   std::vector< Postings > slices(n_slices);
+   pool.parallel_for(n_slices, 1, [&](size_t begin, size_t end) {
+      // the decks are visited in order, so that every list of low bits comes out sorted
+      std::unordered_map< uint64_t, std::vector< uint16_t > > lows_by_key;
+      std::vector< CardIdCount > cards;
+      for(size_t s = begin; s < end; s++) {
+         lows_by_key.clear();
+         size_t first_deck = s * slice_decks;
+         size_t last_deck = std::min(first_deck + slice_decks, n_decks);
+         for(size_t d = first_deck; d < last_deck; d++) {
+            if(failed_decks.contains(d)) {
+               continue;
+            }
+            auto low = static_cast< uint16_t >(d % CONTAINER_DECKS);
+            lows_by_key[KEY_ALL].push_back(low);
+            // cards listed more than once count together
+            cards.assign(decks[d].begin(), decks[d].end());
+            std::sort(cards.begin(), cards.end());
+            uint32_t regions = 0;
+            for(size_t c = 0; c < cards.size(); c++) {
+               size_t count = cards[c].second;
+               for(; c + 1 < cards.size() && cards[c + 1].first == cards[c].first; c++) {
+                  count += cards[c + 1].second;
+               }
+               lows_by_key[card_key(cards[c].first, count)].push_back(low);
+               regions |= uint32_t(1) << static_cast< uint32_t >(cards[c].first.region());
+            }
+            for(; regions != 0; regions &= regions - 1) {
+               auto region = static_cast< Region >(lowest_bit(regions));
+               lows_by_key[region_key(region)].push_back(low);
+            }
+         }
+         slices[s].assign(std::make_move_iterator(lows_by_key.begin()),
+                          std::make_move_iterator(lows_by_key.end()));
+         std::sort(slices[s].begin(), slices[s].end(), [](const auto &l1, const auto &l2) {
+            return l1.first < l2.first;
+         });
+      }
+   });
+
+   // each range of 2^16 decks merges the lists of its slices into its containers
+   size_t n_parts = (n_decks + CONTAINER_DECKS - 1) / CONTAINER_DECKS;
+   std::vector< std::vector< PartContainer > > parts(n_parts);
+   pool.parallel_for(n_parts, 1, [&](size_t begin, size_t end) {
+      std::vector< size_t > cursors;
+      std::vector< const std::vector< uint16_t > * > lists;
+      for(size_t p = begin; p < end; p++) {
+         size_t first_slice = p * slices_per_part;
+         size_t last_slice = std::min(first_slice + slices_per_part, n_slices);
+         cursors.assign(last_slice - first_slice, 0);
+         while(true) {
+            // the smallest key left in any slice, whose lists follow each other in slice order
+            uint64_t key = ~uint64_t(0);
+            for(size_t s = first_slice; s < last_slice; s++) {
+               if(cursors[s - first_slice] < slices[s].size()) {
+                  key = std::min(key, slices[s][cursors[s - first_slice]].first);
+               }
+            }
+            if(key == ~uint64_t(0)) {
+               break;
+            }
+            lists.clear();
+            size_t cardinality = 0;
+            for(size_t s = first_slice; s < last_slice; s++) {
+               size_t &cursor = cursors[s - first_slice];
+               if(cursor < slices[s].size() && slices[s][cursor].first == key) {
+                  lists.push_back(&slices[s][cursor].second);
+                  cardinality += lists.back()->size();
+                  cursor++;
+               }
+            }
+
+            PartContainer container;
+            container.key = key;
+            container.cardinality = static_cast< uint32_t >(cardinality);
+            container.payload.resize(payload_bytes(cardinality) / sizeof(uint64_t));
+            auto *array = reinterpret_cast< uint16_t * >(container.payload.data());
+            for(const auto *lows : lists) {
+               if(cardinality > MAX_ARRAY_DECKS) {
+                  for(uint16_t low : *lows) {
+                     container.payload[low / 64] |= uint64_t(1) << (low % 64);
+                  }
+               } else {
+                  std::memcpy(array, lows->data(), lows->size() * sizeof(uint16_t));
+                  array += lows->size();
+               }
+            }
+            parts[p].push_back(std::move(container));
+         }
+         for(size_t s = first_slice; s < last_slice; s++) {
+            Postings().swap(slices[s]);
+         }
+      }
+   });
+
+   // the containers of all parts by key, and within a key by part, i.e. by their upper bits
+   struct Placed {
+      uint64_t key;
+      uint64_t part;
+      const PartContainer *container;
+   };
+   std::vector< Placed > containers;
+   for(size_t p = 0; p < parts.size(); p++) {
+      for(const auto &container : parts[p]) {
+         containers.push_back({container.key, p, &container});
+      }
+   }
+   std::sort(containers.begin(), containers.end(), [](const auto &c1, const auto &c2) {
+      return c1.key < c2.key || (c1.key == c2.key && c1.part < c2.part);
+   });
+
+   std::vector< uint64_t > keys;
+   std::vector< uint64_t > key_starts;
+   for(size_t c = 0; c < containers.size(); c++) {
+      if(keys.empty() || keys.back() != containers[c].key) {
+         keys.push_back(containers[c].key);
+         key_starts.push_back(c);
+      }
+   }
+   key_starts.push_back(containers.size());
+
+   size_t payload_size = 0;
+   for(const Placed &placed : containers) {
+      payload_size += placed.container->payload.size() * sizeof(uint64_t);
+   }
+   size_t tables_size = INDEX_HEADER_BYTES + (keys.size() + key_starts.size()) * sizeof(uint64_t)
+                        + containers.size() * 2 * sizeof(uint64_t);
+
+   DeckIndex index;
+   index.m_buffer.resize(tables_size + payload_size);
+   char *cursor = index.m_buffer.data();
+   auto put = [&cursor](const void *data, size_t n_bytes) {
+      std::memcpy(cursor, data, n_bytes);
+      cursor += n_bytes;
+   };
+   const uint64_t header[3] = {n_decks, keys.size(), containers.size()};
+   put(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+   put(header, sizeof(header));
+   put(keys.data(), keys.size() * sizeof(uint64_t));
+   put(key_starts.data(), key_starts.size() * sizeof(uint64_t));
+   uint64_t offset = 0;
+   for(const Placed &placed : containers) {
+      const uint64_t entry[2] = {(placed.part << 32U) | placed.container->cardinality, offset};
+      put(entry, sizeof(entry));
+      offset += placed.container->payload.size() * sizeof(uint64_t);
+   }
+   for(const Placed &placed : containers) {
+      const auto &payload = placed.container->payload;
+      put(payload.data(), payload.size() * sizeof(uint64_t));
+   }
+   index._attach(index.m_buffer.data(), index.m_buffer.size());
+   return index;
+}
+
+DeckIndex DeckIndex::load(const std::string &path)
+{
+   DeckIndex index;
+   index.m_file.emplace(path);
+   try {
+      index._attach(index.m_file->data(), index.m_file->size());
+   } catch(std::runtime_error &e) {
+      throw std::runtime_error(path + ": " + e.what());
+   }
+   return index;
+}
+
+void DeckIndex::write(const std::string &path) const
+{
+   std::FILE *file = std::fopen(path.c_str(), "wb");
+   if(file == nullptr) {
+      throw std::runtime_error("Cannot open " + path);
+   }
+   bool ok = std::fwrite(m_data, 1, m_size, file) == m_size;
+   ok = std::fclose(file) == 0 && ok;
+   if(not ok) {
+      throw std::runtime_error("Cannot write " + path);
+   }
+}
+
+void DeckIndex::_attach(const char *data, size_t size)
+{
+   if(size < INDEX_HEADER_BYTES || std::memcmp(data, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0) {
+      throw std::runtime_error("not a deck index file.");
+   }
+   uint64_t header[3];
+   std::memcpy(header, data + sizeof(INDEX_MAGIC), sizeof(header));
+   size_t tables_size = INDEX_HEADER_BYTES + (2 * header[1] + 1) * sizeof(uint64_t)
+                        + header[2] * 2 * sizeof(uint64_t);
+   if(header[1] > size || header[2] > size || tables_size > size) {
+      throw std::runtime_error("the index was cut short.");
+   }
+   // the buffer and the mapping are aligned to 8 bytes, and so is every table within them
+   m_data = data;
+   m_size = size;
+   m_n_decks = header[0];
+   m_n_keys = header[1];
+   m_n_containers = header[2];
+   m_keys = reinterpret_cast< const uint64_t * >(data + INDEX_HEADER_BYTES);
+   m_key_starts = m_keys + m_n_keys;
+   m_containers = m_key_starts + m_n_keys + 1;
+   m_payload = data + tables_size;
+   m_payload_size = size - tables_size;
+
+   if(m_key_starts[m_n_keys] != m_n_containers) {
+      throw std::runtime_error("the index was cut short.");
+   }
+   // the key starts address the container table when evaluating a query
+   for(size_t k = 0; k < m_n_keys; k++) {
+      if(m_key_starts[k] > m_key_starts[k + 1]) {
+         throw std::runtime_error("the index is corrupt.");
+      }
+   }
+   for(size_t c = 0; c < m_n_containers; c++) {
+      uint64_t cardinality = m_containers[2 * c] & 0xFFFFFFFFU;
+      uint64_t offset = m_containers[2 * c + 1];
+      if(cardinality > CONTAINER_DECKS || offset > m_payload_size
+         || payload_bytes(cardinality) > m_payload_size - offset) {
+         throw std::runtime_error("the index was cut short.");
+      }
+   }
+}
+
+DeckSet DeckIndex::query(const DeckQuery &query) const
+{
+   return _evaluate(query);
+}
+
+void DeckIndex::_add_postings(uint64_t first_key, uint64_t last_key, DeckSet &decks) const
+{
+   if(m_n_keys == 0) {
+      return;
+   }
+   const uint64_t *first = std::lower_bound(m_keys, m_keys + m_n_keys, first_key);
+   const uint64_t *last = std::upper_bound(first, m_keys + m_n_keys, last_key);
+   std::vector< uint64_t > &words = decks.words();
+   for(size_t c = m_key_starts[first - m_keys]; c < m_key_starts[last - m_keys]; c++) {
+      uint64_t high = m_containers[2 * c] >> 32U;
+      uint64_t cardinality = m_containers[2 * c] & 0xFFFFFFFFU;
+      const char *payload = m_payload + m_containers[2 * c + 1];
+      size_t first_word = high * BITMAP_WORDS;
+      if(first_word >= words.size()) {
+         continue;
+      }
+      if(cardinality > MAX_ARRAY_DECKS) {
+         size_t n_words = std::min(BITMAP_WORDS, words.size() - first_word);
+         combine< SetOp::OR >(
+            words.data() + first_word, reinterpret_cast< const uint64_t * >(payload), n_words);
+      } else {
+         const auto *lows = reinterpret_cast< const uint16_t * >(payload);
+         size_t base = high << CONTAINER_BITS;
+         for(size_t i = 0; i < cardinality; i++) {
+            size_t deck = base + lows[i];
+            if(deck < decks.universe()) {
+               decks.insert(deck);
+            }
+         }
+      }
+   }
+}
+
+DeckSet DeckIndex::_evaluate(const DeckQuery &query) const
+{
+   const DeckQuery::Term &term = *query.m_term;
+   DeckSet decks(m_n_decks);
+   switch(term.op) {
+      case DeckQuery::Op::ALL:
+         _add_postings(KEY_ALL, KEY_ALL, decks);
+         break;
+      case DeckQuery::Op::CARD:
+         if(term.min_count <= term.max_count) {
+            uint64_t first_key = card_key(term.id, term.min_count);
+            _add_postings(first_key, card_key(term.id, term.max_count), decks);
+         }
+         break;
+      case DeckQuery::Op::REGION:
+         _add_postings(region_key(term.region), region_key(term.region), decks);
+         break;
+      case DeckQuery::Op::AND: {
+         // the negated operands are subtracted from the intersection of the others
+         bool first = true;
+         for(const DeckQuery &operand : term.operands) {
+            if(operand.m_term->op != DeckQuery::Op::NOT) {
+               if(first) {
+                  decks = _evaluate(operand);
+                  first = false;
+               } else {
+                  decks &= _evaluate(operand);
+               }
+            }
+         }
+         if(first) {
+            _add_postings(KEY_ALL, KEY_ALL, decks);
+         }
+         for(const DeckQuery &operand : term.operands) {
+            if(operand.m_term->op == DeckQuery::Op::NOT) {
+               decks.subtract(_evaluate(operand.m_term->operands.front()));
+            }
+         }
+         break;
+      }
+      case DeckQuery::Op::OR:
+         for(const DeckQuery &operand : term.operands) {
+            decks |= _evaluate(operand);
+         }
+         break;
+      case DeckQuery::Op::NOT:
+         _add_postings(KEY_ALL, KEY_ALL, decks);
+         decks.subtract(_evaluate(term.operands.front()));
+         break;
+   }
+   return decks;
+}
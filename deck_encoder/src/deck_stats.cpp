@@ -0,0 +1,369 @@
+
+#include "deck_codec/deck_stats.h"
+
+#include <algorithm>
+#include <exception>
+
+#include "deck_codec/codec.h"
+
+namespace {
+
+constexpr uint64_t pair_key(CardId id1, CardId id2)
+{
+   return (uint64_t(id1.value()) << 32U) | id2.value();
+}
+
+/// the cards of a pair key, the key's first card is the lower id
+constexpr CardId first_of(uint64_t key)
+{
+   return CardId::from_value(static_cast< uint32_t >(key >> 32U));
+}
+
+constexpr CardId second_of(uint64_t key)
+{
+   return CardId::from_value(static_cast< uint32_t >(key));
+}
+
+/// orders co-occurring cards by number of decks descending, then by id
+bool ranks_before(const CoOccurrence &c1, const CoOccurrence &c2)
+{
+   return c1.n_decks > c2.n_decks || (c1.n_decks == c2.n_decks && c1.id < c2.id);
+}
+
+/// keeps the top k cards in a heap whose front is the lowest ranked one
+void offer(std::vector< CoOccurrence > &heap, size_t k, CoOccurrence candidate)
+{
+   if(heap.size() < k) {
+      heap.push_back(candidate);
+      std::push_heap(heap.begin(), heap.end(), ranks_before);
+   } else if(k > 0 && ranks_before(candidate, heap.front())) {
+      std::pop_heap(heap.begin(), heap.end(), ranks_before);
+      heap.back() = candidate;
+      std::push_heap(heap.begin(), heap.end(), ranks_before);
+   }
+}
+
+static_assert(REGION_INFO.size() <= 32, "The regions of a deck are collected in 32-bit masks.");
+
+}  // namespace
+
+void DeckStats::add_code(std::string_view deck_code)
+{
+   thread_local std::vector< CardIdCount > cards;
+   cards.clear();
+   try {
+      DeckCodec::decode_each(deck_code, [](CardId id, size_t count) {
+         cards.emplace_back(id, count);
+      });
+   } catch(std::exception &) {
+      m_n_failed++;
+      return;
+   }
+   _add_sorted(cards);
+}
+
+void DeckStats::add_decks(const DeckBatch &decks, ThreadPool &pool)
+{
+   _add_decks(decks, decks.failed.data(), decks.failed.size(), pool);
+}
+
+void DeckStats::add_decks(const MappedColumns &decks, ThreadPool &pool)
+{
+   _add_decks(decks, decks.failed(), decks.n_failed(), pool);
+}
+
+template < typename Decks >
+void DeckStats::_add_decks(
+   const Decks &decks, const uint64_t *failed, size_t n_failed, ThreadPool &pool)
+{
+   size_t n_decks = decks.size();
+   size_t n_parts = std::min(n_decks, std::max(pool.size(), size_t(1)) * 4);
+   std::vector< DeckStats > parts(n_parts);
+   pool.parallel_for(n_parts, 1, [&](size_t begin, size_t end) {
+      for(size_t p = begin; p < end; p++) {
+         size_t first = p * n_decks / n_parts;
+         size_t last = (p + 1) * n_decks / n_parts;
+         // the failed decks of the part, ascending like its decks as MappedColumns validates
+         const uint64_t *next_failed = std::lower_bound(failed, failed + n_failed, first);
+         for(size_t i = first; i < last; i++) {
+            if(next_failed != failed + n_failed && *next_failed == i) {
+               next_failed++;
+               parts[p].m_n_failed++;
+               continue;
+            }
+            parts[p].add_deck(decks[i]);
+         }
+      }
+   });
+   _merge_parts(parts, pool);
+}
+
+void DeckStats::merge(const DeckStats &other)
+{
+   m_n_decks += other.m_n_decks;
+   m_n_failed += other.m_n_failed;
+   for(const CardStats &card : other.m_cards) {
+      CardStats &totals = m_cards[_slot(card.id)];
+      totals.n_decks += card.n_decks;
+      totals.n_copies += card.n_copies;
+   }
+   const auto &keys = other.m_pairs.keys();
+   for(size_t i = 0; i < keys.size(); i++) {
+      if(keys[i] != PairCounts::EMPTY) {
+         m_pairs.add(keys[i], other.m_pairs.counts()[i]);
+      }
+   }
+   for(size_t i = 0; i < m_region_pairs.size(); i++) {
+      m_region_pairs[i] += other.m_region_pairs[i];
+   }
+}
+
+void DeckStats::_merge_parts(std::vector< DeckStats > &parts, ThreadPool &pool)
+{
+   // merging rounds of doubling stride, each merging disjoint pairs of partials in parallel
+   for(size_t stride = 1; stride < parts.size(); stride *= 2) {
+      size_t n_merges = (parts.size() + 2 * stride - 1) / (2 * stride);
+      pool.parallel_for(n_merges, 1, [&](size_t begin, size_t end) {
+         for(size_t m = begin; m < end; m++) {
+            size_t into = m * 2 * stride;
+            size_t from = into + stride;
+            if(from >= parts.size()) {
+               continue;
+            }
+            // the larger pair table takes in the smaller one
+            if(parts[into].n_pairs() < parts[from].n_pairs()) {
+               std::swap(parts[into], parts[from]);
+            }
+            parts[into].merge(parts[from]);
+            parts[from] = DeckStats();
+         }
+      });
+   }
+   if(parts.empty()) {
+      return;
+   }
+   if(m_n_decks == 0 && m_n_failed == 0) {
+      *this = std::move(parts.front());
+   } else {
+      merge(parts.front());
+   }
+}
+
+void DeckStats::_add_sorted(std::vector< CardIdCount > &cards)
+{
+   // cards listed more than once count together
+   std::sort(cards.begin(), cards.end());
+   size_t n_cards = 0;
+   for(size_t c = 0; c < cards.size(); c++) {
+      if(n_cards > 0 && cards[n_cards - 1].first == cards[c].first) {
+         cards[n_cards - 1].second += cards[c].second;
+      } else {
+         cards[n_cards++] = cards[c];
+      }
+   }
+   cards.resize(n_cards);
+
+   m_n_decks++;
+   uint32_t regions = 0;
+   for(size_t c = 0; c < n_cards; c++) {
+      const auto &[id, count] = cards[c];
+      CardStats &totals = m_cards[_slot(id)];
+      totals.n_decks++;
+      totals.n_copies += count;
+      regions |= uint32_t(1) << static_cast< uint32_t >(id.region());
+      for(size_t other = c + 1; other < n_cards; other++) {
+         m_pairs.add(pair_key(id, cards[other].first), 1);
+      }
+   }
+   for(size_t r1 = 0; r1 < N_REGIONS; r1++) {
+      if((regions >> r1) & 1U) {
+         for(size_t r2 = r1; r2 < N_REGIONS; r2++) {
+            m_region_pairs[r1 * N_REGIONS + r2] += (regions >> r2) & 1U;
+         }
+      }
+   }
+}
+
+uint32_t DeckStats::_slot(CardId id)
+{
+   if(m_group_index.empty()) {
+      m_group_index.assign(size_t(1) << 16U, NO_SLOT);
+   }
+   uint32_t &group = m_group_index[id.group()];
+   if(group == NO_SLOT) {
+      group = static_cast< uint32_t >(m_group_slots.size());
+      m_group_slots.emplace_back();
+   }
+   std::vector< uint32_t > &slots = m_group_slots[group];
+   if(id.number() >= slots.size()) {
+      slots.resize(id.number() + 1, NO_SLOT);
+   }
+   uint32_t &slot = slots[id.number()];
+   if(slot == NO_SLOT) {
+      slot = static_cast< uint32_t >(m_cards.size());
+      m_cards.push_back({id, 0, 0});
+   }
+   return slot;
+}
+
+uint32_t DeckStats::_find_slot(CardId id) const
+{
+   if(m_group_index.empty() || m_group_index[id.group()] == NO_SLOT) {
+      return NO_SLOT;
+   }
+   const std::vector< uint32_t > &slots = m_group_slots[m_group_index[id.group()]];
+   return id.number() < slots.size() ? slots[id.number()] : NO_SLOT;
+}
+
+CardStats DeckStats::card(CardId id) const
+{
+   uint32_t slot = _find_slot(id);
+   return slot == NO_SLOT ? CardStats{id, 0, 0} : m_cards[slot];
+}
+
+std::vector< CardStats > DeckStats::cards() const
+{
+   std::vector< CardStats > cards = m_cards;
+   std::sort(cards.begin(), cards.end(), [](const CardStats &c1, const CardStats &c2) {
+      return c1.id < c2.id;
+   });
+   return cards;
+}
+
+double DeckStats::play_rate(CardId id) const
+{
+   if(m_n_decks == 0) {
+      return 0.0;
+   }
+   return static_cast< double >(card(id).n_decks) / static_cast< double >(m_n_decks);
+}
+
+uint64_t DeckStats::co_occurrences(CardId id1, CardId id2) const
+{
+   if(id1 == id2) {
+      return card(id1).n_decks;
+   }
+   return m_pairs.get(id1 < id2 ? pair_key(id1, id2) : pair_key(id2, id1));
+}
+
+std::vector< CoOccurrence > DeckStats::top_co_occurring(CardId id, size_t k) const
+{
+   std::vector< CoOccurrence > top;
+   const auto &keys = m_pairs.keys();
+   for(size_t i = 0; i < keys.size(); i++) {
+      if(keys[i] == PairCounts::EMPTY) {
+         continue;
+      }
+      if(first_of(keys[i]) == id) {
+         offer(top, k, {second_of(keys[i]), m_pairs.counts()[i]});
+      } else if(second_of(keys[i]) == id) {
+         offer(top, k, {first_of(keys[i]), m_pairs.counts()[i]});
+      }
+   }
+   std::sort_heap(top.begin(), top.end(), ranks_before);
+   return top;
+}
+
+std::vector< std::pair< CardId, std::vector< CoOccurrence > > > DeckStats::top_co_occurring(
+   size_t k) const
+{
+   std::vector< std::vector< CoOccurrence > > tops(m_cards.size());
+   const auto &keys = m_pairs.keys();
+   for(size_t i = 0; i < keys.size(); i++) {
+      if(keys[i] == PairCounts::EMPTY) {
+         continue;
+      }
+      CardId id1 = first_of(keys[i]);
+      CardId id2 = second_of(keys[i]);
+      uint64_t n_decks = m_pairs.counts()[i];
+      offer(tops[_find_slot(id1)], k, {id2, n_decks});
+      offer(tops[_find_slot(id2)], k, {id1, n_decks});
+   }
+
+   std::vector< std::pair< CardId, std::vector< CoOccurrence > > > result;
+   result.reserve(m_cards.size());
+   for(size_t slot = 0; slot < m_cards.size(); slot++) {
+      std::sort_heap(tops[slot].begin(), tops[slot].end(), ranks_before);
+      result.emplace_back(m_cards[slot].id, std::move(tops[slot]));
+   }
+   std::sort(result.begin(), result.end(), [](const auto &c1, const auto &c2) {
+      return c1.first < c2.first;
+   });
+   return result;
+}
+
+uint64_t DeckStats::region_pair(Region region1, Region region2) const
+{
+   auto r1 = static_cast< size_t >(region1);
+   auto r2 = static_cast< size_t >(region2);
+   return m_region_pairs[std::min(r1, r2) * N_REGIONS + std::max(r1, r2)];
+}
+
+std::vector< RegionPairCount > DeckStats::region_pairs() const
+{
+   std::vector< RegionPairCount > pairs;
+   for(size_t r1 = 0; r1 < N_REGIONS; r1++) {
+      for(size_t r2 = r1 + 1; r2 < N_REGIONS; r2++) {
+         if(m_region_pairs[r1 * N_REGIONS + r2] > 0) {
+            pairs.push_back(
+               {static_cast< Region >(r1),
+                static_cast< Region >(r2),
+                m_region_pairs[r1 * N_REGIONS + r2]});
+         }
+      }
+   }
+   std::stable_sort(pairs.begin(), pairs.end(), [](const auto &p1, const auto &p2) {
+      return p1.n_decks > p2.n_decks;
+   });
+   return pairs;
+}
+
+void DeckStats::PairCounts::add(uint64_t key, uint64_t n)
+{
+   // at most half full, so that probe sequences stay short
+   if(2 * (m_size + 1) > m_keys.size()) {
+      _grow();
+   }
+   size_t i = _find(key);
+   if(m_keys[i] == EMPTY) {
+      m_keys[i] = key;
+      m_size++;
+   }
+   m_counts[i] += n;
+}
+
+uint64_t DeckStats::PairCounts::get(uint64_t key) const
+{
+   if(m_keys.empty()) {
+      return 0;
+   }
+   size_t i = _find(key);
+   return m_keys[i] == key ? m_counts[i] : 0;
+}
+
+size_t DeckStats::PairCounts::_find(uint64_t key) const
+{
+   // the upper bits of a multiplicative hash mix both card ids
+   size_t mask = m_keys.size() - 1;
+   uint64_t hash = key * 0x9E3779B97F4A7C15ULL;
+   size_t i = static_cast< size_t >(hash ^ (hash >> 32U)) & mask;
+   while(m_keys[i] != key && m_keys[i] != EMPTY) {
+      i = (i + 1) & mask;
+   }
+   return i;
+}
+
+void DeckStats::PairCounts::_grow()
+{
+   std::vector< uint64_t > keys(std::max(m_keys.size() * 2, size_t(64)), EMPTY);
+   std::vector< uint64_t > counts(keys.size(), 0);
+   std::swap(keys, m_keys);
+   std::swap(counts, m_counts);
+   for(size_t i = 0; i < keys.size(); i++) {
+      if(keys[i] != EMPTY) {
+         size_t slot = _find(keys[i]);
+         m_keys[slot] = keys[i];
+         m_counts[slot] = counts[i];
+      }
+   }
+}
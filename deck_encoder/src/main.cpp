@@ -1,23 +1,532 @@
 
-
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
-#include <queue>
-#include <set>
-#include <stack>
-#include <unordered_set>
-#include <utility>
-#include <variant>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <vector>
 
-#include "../test/read_cases.h"
-#include "include/base32.h"
+#include "deck_codec/codec.h"
+
+/**
+ * deck_codec_cli, the command line front end for bulk conversions.
+ *
+ *    deck_codec_cli decode [--format csv|jsonl] [--threads N] [--batch N] [-o FILE] [FILE]
+ *       reads one deck code per line and writes the decoded decks
+ *    deck_codec_cli encode [--format csv|jsonl] [--threads N] [--batch N] [-o FILE] [FILE]
+ *       reads decks as blocks of "count:card_code" lines separated by blank lines (the format of
+ *       test/test_cases.txt, other lines of a block are ignored) and writes their deck codes
+ *
+ * Input is read from stdin if no file is given. Records are processed in batches on a thread pool
+ * and written in input order. A record that fails produces an error entry instead of aborting the
+ * run. A throughput summary goes to stderr at exit.
+ */
+
+namespace {
+
+enum class Mode { DECODE, ENCODE };
+enum class Format { CSV, JSONL };
+
+struct Options {
+   Mode mode = Mode::DECODE;
+   Format format = Format::CSV;
+   size_t n_threads = 0;
+   size_t batch_size = 1 << 16;
+   std::string input;
+   std::string output;
+};
+
+struct Stats {
+   size_t n_records = 0;
+   size_t n_cards = 0;
+   size_t n_errors = 0;
+   size_t n_bytes_in = 0;
+   size_t n_bytes_out = 0;
+};
 
-int main() {
-   for(auto& [code, dc] : read_case_file("../tests/test_cases.txt")) {
-      std::cout << code << "\n";
-      for(auto cardcount : dc) {
-         std::cout << "code " << cardcount.code() << " <-> count: " << cardcount.count() << "\n";
+constexpr size_t READ_CHUNK = 1 << 22;
+constexpr size_t IO_BUFFER = 1 << 20;
+
+void print_usage(std::FILE *stream)
+{
+   std::fputs(
+      "usage: deck_codec_cli decode|encode [--format csv|jsonl] [--threads N] [--batch N]\n"
+      "                      [-o FILE] [FILE]\n"
+      "  decode  read one deck code per line, write the cards of each deck\n"
+      "  encode  read blocks of count:card_code lines separated by blank lines, write deck codes\n"
+      "  --format   output format, csv (default) or jsonl\n"
+      "  --threads  number of worker threads, default: hardware concurrency\n"
+      "  --batch    number of records processed per batch, default: 65536\n"
+      "  -o         output file, default: stdout\n",
+      stream);
+}
+
+std::optional< Options > parse_args(int argc, char **argv)
+{
+   if(argc < 2) {
+      return std::nullopt;
+   }
+   Options opts;
+   std::string_view mode = argv[1];
+   if(mode == "decode") {
+      opts.mode = Mode::DECODE;
+   } else if(mode == "encode") {
+      opts.mode = Mode::ENCODE;
+   } else {
+      return std::nullopt;
+   }
+   auto parse_count = [](const char *arg, size_t &value) {
+      char *end = nullptr;
+      unsigned long long parsed = std::strtoull(arg, &end, 10);
+      if(end == arg || *end != '\0') {
+         return false;
+      }
+      value = static_cast< size_t >(parsed);
+      return true;
+   };
+   for(int i = 2; i < argc; i++) {
+      std::string_view arg = argv[i];
+      bool has_value = i + 1 < argc;
+      if(arg == "--format" && has_value) {
+         std::string_view format = argv[++i];
+         if(format == "csv") {
+            opts.format = Format::CSV;
+         } else if(format == "jsonl") {
+            opts.format = Format::JSONL;
+         } else {
+            return std::nullopt;
+         }
+      } else if(arg == "--threads" && has_value) {
+         if(not parse_count(argv[++i], opts.n_threads)) {
+            return std::nullopt;
+         }
+      } else if(arg == "--batch" && has_value) {
+         if(not parse_count(argv[++i], opts.batch_size) || opts.batch_size == 0) {
+            return std::nullopt;
+         }
+      } else if(arg == "-o" && has_value) {
+         opts.output = argv[++i];
+      } else if(not arg.empty() && arg[0] != '-' && opts.input.empty()) {
+         opts.input = arg;
+      } else {
+         return std::nullopt;
       }
+   }
+   return opts;
+}
+
+void append_number(std::string &out, uint64_t value, size_t width)
+{
+   char digits[20];
+   size_t len = 0;
+   do {
+      digits[len++] = static_cast< char >('0' + value % 10);
+      value /= 10;
+   } while(value != 0);
+   for(; width > len; width--) {
+      out.push_back('0');
+   }
+   while(len > 0) {
+      out.push_back(digits[--len]);
+   }
+}
+
+/// appends the card code XXYYZZZ without building an intermediate string
+void append_card_code(std::string &out, CardId id)
+{
+   append_number(out, id.set(), 2);
+   out.append(REGION_INFO[static_cast< size_t >(id.region())].initials, 2);
+   append_number(out, id.number(), 3);
+}
+
+void append_csv_field(std::string &out, std::string_view field)
+{
+   if(field.find_first_of(",\"\n\r") == std::string_view::npos) {
+      out.append(field);
+      return;
+   }
+   out.push_back('"');
+   for(char c : field) {
+      if(c == '"') {
+         out.push_back('"');
+      }
+      out.push_back(c);
+   }
+   out.push_back('"');
+}
+
+void append_json_string(std::string &out, std::string_view str)
+{
+   out.push_back('"');
+   for(char c : str) {
+      switch(c) {
+         case '"': out.append("\\\""); break;
+         case '\\': out.append("\\\\"); break;
+         case '\n': out.append("\\n"); break;
+         case '\r': out.append("\\r"); break;
+         case '\t': out.append("\\t"); break;
+         default:
+            if(static_cast< unsigned char >(c) < 0x20) {
+               constexpr const char *hex = "0123456789abcdef";
+               out.append("\\u00");
+               out.push_back(hex[(c >> 4) & 0xF]);
+               out.push_back(hex[c & 0xF]);
+            } else {
+               out.push_back(c);
+            }
+      }
+   }
+   out.push_back('"');
+}
+
+std::string_view trim(std::string_view str)
+{
+   while(not str.empty() && std::isspace(static_cast< unsigned char >(str.front()))) {
+      str.remove_prefix(1);
+   }
+   while(not str.empty() && std::isspace(static_cast< unsigned char >(str.back()))) {
+      str.remove_suffix(1);
+   }
+   return str;
+}
+
+/**
+ * Splits the buffer into records: non-empty lines when decoding, blocks of lines separated by blank
+ * lines when encoding. Only records followed by a boundary are taken unless at_eof is set.
+ * @return size_t,
+ *      the number of bytes consumed
+ */
+size_t split_records(
+   std::string_view buffer, Mode mode, bool at_eof, std::vector< std::string_view > &records)
+{
+   size_t consumed = 0;
+   size_t record_begin = 0;
+   size_t pos = 0;
+   while(pos < buffer.size()) {
+      size_t line_end = buffer.find('\n', pos);
+      if(line_end == std::string_view::npos) {
+         if(not at_eof) {
+            break;
+         }
+         line_end = buffer.size();
+      }
+      std::string_view line = trim(buffer.substr(pos, line_end - pos));
+      pos = std::min(line_end + 1, buffer.size());
+      if(mode == Mode::DECODE) {
+         if(not line.empty()) {
+            records.push_back(line);
+         }
+         consumed = pos;
+      } else if(line.empty()) {
+         std::string_view block = trim(buffer.substr(record_begin, pos - record_begin));
+         if(not block.empty()) {
+            records.push_back(block);
+         }
+         record_begin = consumed = pos;
+      }
+   }
+   if(mode == Mode::ENCODE && at_eof && record_begin < buffer.size()) {
+      std::string_view block = trim(buffer.substr(record_begin));
+      if(not block.empty()) {
+         records.push_back(block);
+      }
+      consumed = buffer.size();
+   }
+   return consumed;
+}
+
+/// parses a block of count:card_code lines into the deck, throws on malformed lines
+void parse_block(std::string_view block, std::vector< CardIdCount > &deck)
+{
+   deck.clear();
+   while(not block.empty()) {
+      size_t line_end = std::min(block.find('\n'), block.size());
+      std::string_view line = trim(block.substr(0, line_end));
+      block.remove_prefix(std::min(line_end + 1, block.size()));
+
+      size_t delim = line.find(':');
+      if(delim == std::string_view::npos) {
+         // e.g. the expected code heading a block of test_cases.txt
+         continue;
+      }
+      size_t count = 0;
+      std::string_view count_str = trim(line.substr(0, delim));
+      if(count_str.empty() || count_str.size() > 9) {
+         throw std::invalid_argument("Invalid card count in line: " + std::string(line));
+      }
+      for(char c : count_str) {
+         if(c < '0' || c > '9') {
+            throw std::invalid_argument("Invalid card count in line: " + std::string(line));
+         }
+         count = count * 10 + static_cast< size_t >(c - '0');
+      }
+      deck.emplace_back(DeckCodec::parse_card_id(trim(line.substr(delim + 1))), count);
+   }
+}
+
+class Converter {
+  public:
+   Converter(const Options &opts, ThreadPool &pool, std::FILE *out)
+       : m_opts(opts), m_pool(pool), m_out(out)
+   {
+   }
+
+   void write_header()
+   {
+      if(m_opts.format == Format::CSV) {
+         write(m_opts.mode == Mode::DECODE ? "code,card,count,error\n" : "code,error\n");
+      }
+   }
+
+   /// converts the records in parallel and writes the results in input order
+   void process(const std::vector< std::string_view > &records)
+   {
+      m_results.resize(std::max(m_results.size(), records.size()));
+      if(m_opts.mode == Mode::DECODE) {
+         m_decoded.resize(std::max(m_decoded.size(), records.size()));
+         DeckCodec::decode_batch_to< CardIdCount >(records, m_decoded.begin(), m_pool);
+      }
+      m_pool.parallel_for(records.size(), 0, [&](size_t begin, size_t end) {
+         // reused by the records of the chunk
+         std::vector< CardIdCount > deck;
+         std::string code;
+         for(size_t i = begin; i < end; i++) {
+            m_results[i].text.clear();
+            if(m_opts.mode == Mode::DECODE) {
+               _format_decoded(records[i], m_decoded[i], m_results[i]);
+            } else {
+               _encode_block(records[i], deck, code, m_results[i]);
+            }
+         }
+      });
+      for(size_t i = 0; i < records.size(); i++) {
+         m_stats.n_errors += not m_results[i].ok;
+         m_stats.n_cards += m_results[i].n_cards;
+         write(m_results[i].text);
+      }
+      m_stats.n_records += records.size();
+   }
+
+   void write(std::string_view data)
+   {
+      std::fwrite(data.data(), 1, data.size(), m_out);
+      m_stats.n_bytes_out += data.size();
+   }
+
+   Stats &stats() { return m_stats; }
+
+  private:
+   /// the output of one record
+   struct Result {
+      std::string text;
+      size_t n_cards = 0;
+      bool ok = true;
+   };
+
+   void _format_decoded(
+      std::string_view code,
+      const BatchItem< std::vector< CardIdCount > > &item,
+      Result &result) const
+   {
+      std::string &out = result.text;
+      result.ok = item.ok();
+      result.n_cards = item.value.size();
+      if(m_opts.format == Format::CSV) {
+         if(not item.ok()) {
+            append_csv_field(out, code);
+            out.append(",,,");
+            append_csv_field(out, item.error);
+            out.push_back('\n');
+         }
+         for(const auto &[id, count] : item.value) {
+            append_csv_field(out, code);
+            out.push_back(',');
+            append_card_code(out, id);
+            out.push_back(',');
+            append_number(out, count, 1);
+            out.append(",\n");
+         }
+         return;
+      }
+      out.append("{\"code\":");
+      append_json_string(out, code);
+      if(not item.ok()) {
+         out.append(",\"error\":");
+         append_json_string(out, item.error);
+         out.append("}\n");
+         return;
+      }
+      out.append(",\"cards\":[");
+      for(size_t i = 0; i < item.value.size(); i++) {
+         out.append(i == 0 ? "{\"code\":\"" : ",{\"code\":\"");
+         append_card_code(out, item.value[i].first);
+         out.append("\",\"count\":");
+         append_number(out, item.value[i].second, 1);
+         out.push_back('}');
+      }
+      out.append("]}\n");
+   }
+
+   void _encode_block(
+      std::string_view block,
+      std::vector< CardIdCount > &deck,
+      std::string &code,
+      Result &result) const
+   {
+      std::string &out = result.text;
+      std::string error;
+      code.clear();
+      try {
+         parse_block(block, deck);
+         code.resize(DeckCodec::max_encoded_size(deck));
+         code.resize(DeckCodec::encode_to(deck, code.data(), code.size()));
+      } catch(std::exception &e) {
+         code.clear();
+         error = e.what();
+      }
+      result.ok = error.empty();
+      result.n_cards = result.ok ? deck.size() : 0;
+      if(m_opts.format == Format::CSV) {
+         append_csv_field(out, code);
+         out.push_back(',');
+         append_csv_field(out, error);
+         out.push_back('\n');
+      } else if(error.empty()) {
+         out.append("{\"code\":");
+         append_json_string(out, code);
+         out.append("}\n");
+      } else {
+         out.append("{\"error\":");
+         append_json_string(out, error);
+         out.append("}\n");
+      }
+   }
+
+   const Options &m_opts;
+   ThreadPool &m_pool;
+   std::FILE *m_out;
+   Stats m_stats;
+   std::vector< BatchItem< std::vector< CardIdCount > > > m_decoded;
+   std::vector< Result > m_results;
+};
+
+int run(const Options &opts)
+{
+   using clock = std::chrono::steady_clock;
+   auto start = clock::now();
+
+   std::FILE *in = stdin;
+   std::FILE *out = stdout;
+   if(not opts.input.empty() && (in = std::fopen(opts.input.c_str(), "rb")) == nullptr) {
+      std::cerr << "deck_codec_cli: cannot open " << opts.input << "\n";
+      return 1;
+   }
+   if(not opts.output.empty() && (out = std::fopen(opts.output.c_str(), "wb")) == nullptr) {
+      std::cerr << "deck_codec_cli: cannot open " << opts.output << "\n";
+      if(in != stdin) {
+         std::fclose(in);
+      }
+      return 1;
+   }
+   // stdout keeps its buffer until exit, so the buffer has to outlive this function
+   static std::vector< char > out_buffer(IO_BUFFER);
+   std::setvbuf(out, out_buffer.data(), _IOFBF, out_buffer.size());
+
+   std::unique_ptr< ThreadPool > own_pool;
+   if(opts.n_threads > 0) {
+      own_pool = std::make_unique< ThreadPool >(opts.n_threads);
+   }
+   ThreadPool &pool = own_pool ? *own_pool : ThreadPool::global();
+
+   Converter converter(opts, pool, out);
+   converter.write_header();
+
+   std::string buffer;
+   std::vector< std::string_view > records;
+   std::vector< std::string_view > batch;
+   size_t begin = 0;
+   bool at_eof = false;
+   bool read_failed = false;
+   while(not at_eof) {
+      // move the unprocessed tail to the front and refill behind it
+      buffer.erase(0, begin);
+      begin = 0;
+      size_t filled = buffer.size();
+      buffer.resize(filled + READ_CHUNK);
+      size_t n_read = std::fread(buffer.data() + filled, 1, READ_CHUNK, in);
+      buffer.resize(filled + n_read);
+      converter.stats().n_bytes_in += n_read;
+      at_eof = n_read < READ_CHUNK;
+      // a short read is either the end of the input or an error, which must not pass as the end
+      read_failed = at_eof && std::ferror(in) != 0;
+
+      // only complete records are taken, the tail waits for the next read
+      records.clear();
+      size_t consumed = split_records(
+         std::string_view(buffer).substr(begin), opts.mode, at_eof, records);
+      for(size_t first = 0; first < records.size(); first += opts.batch_size) {
+         size_t last = std::min(records.size(), first + opts.batch_size);
+         batch.assign(
+            records.begin() + static_cast< std::ptrdiff_t >(first),
+            records.begin() + static_cast< std::ptrdiff_t >(last));
+         converter.process(batch);
+      }
+      begin += consumed;
+   }
+
+   // a full disk may only show once the buffered output is flushed or closed
+   bool write_failed = std::fflush(out) != 0 || std::ferror(out) != 0;
+   if(out != stdout) {
+      write_failed = std::fclose(out) != 0 || write_failed;
+   }
+   if(in != stdin) {
+      std::fclose(in);
+   }
+   if(read_failed) {
+      std::cerr << "deck_codec_cli: cannot read "
+                << (opts.input.empty() ? std::string("stdin") : opts.input) << "\n";
+   }
+   if(write_failed) {
+      std::cerr << "deck_codec_cli: cannot write "
+                << (opts.output.empty() ? std::string("stdout") : opts.output) << "\n";
+   }
+
+   const Stats &stats = converter.stats();
+   double seconds = std::chrono::duration< double >(clock::now() - start).count();
+   double safe_seconds = std::max(seconds, 1e-9);
+   std::fprintf(
+      stderr,
+      "deck_codec_cli: %s %zu decks (%zu cards, %zu errors) in %.3f s, %.0f decks/s, "
+      "%.1f MB/s in, %.1f MB/s out\n",
+      opts.mode == Mode::DECODE ? "decoded" : "encoded",
+      stats.n_records,
+      stats.n_cards,
+      stats.n_errors,
+      seconds,
+      static_cast< double >(stats.n_records) / safe_seconds,
+      static_cast< double >(stats.n_bytes_in) / 1e6 / safe_seconds,
+      static_cast< double >(stats.n_bytes_out) / 1e6 / safe_seconds);
+   if(read_failed || write_failed) {
+      return 1;
+   }
+   return stats.n_errors == 0 ? 0 : 2;
+}
+
+}  // namespace
 
+int main(int argc, char **argv)
+{
+   auto opts = parse_args(argc, argv);
+   if(not opts) {
+      print_usage(stderr);
+      return 1;
    }
-}
\ No newline at end of file
+   return run(*opts);
+}
@@ -0,0 +1,141 @@
+
+#include "deck_codec/thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t n_threads)
+{
+   for(size_t i = 0; i < n_threads; i++) {
+      m_queues.emplace_back(std::make_unique< WorkQueue >());
+   }
+   for(size_t i = 0; i < n_threads; i++) {
+      m_workers.emplace_back([this, i] { _worker_loop(i); });
+   }
+}
+
+ThreadPool::~ThreadPool()
+{
+   {
+      std::lock_guard< std::mutex > lock(m_mutex);
+      m_stop = true;
+   }
+   m_wakeup.notify_all();
+   for(auto &worker : m_workers) {
+      worker.join();
+   }
+}
+
+ThreadPool &ThreadPool::global()
+{
+   static ThreadPool pool;
+   return pool;
+}
+
+void ThreadPool::parallel_for(
+   size_t n, size_t grain, const std::function< void(size_t, size_t) > &task)
+{
+   if(n == 0) {
+      return;
+   }
+   if(grain == 0) {
+      // a few chunks per worker leave room for stealing when chunks take uneven time
+      grain = std::max(size_t(1), n / (std::max(size(), size_t(1)) * 8));
+   }
+   if(size() == 0 || n <= grain) {
+      task(0, n);
+      return;
+   }
+
+   Job job;
+   job.task = &task;
+   size_t n_chunks = (n + grain - 1) / grain;
+   job.remaining = n_chunks;
+   {
+      // announce the chunks before queueing them so that the counter never drops below zero
+      std::lock_guard< std::mutex > lock(m_mutex);
+      m_queued += n_chunks;
+   }
+   for(size_t c = 0; c < n_chunks; c++) {
+      auto &queue = *m_queues[c % m_queues.size()];
+      std::lock_guard< std::mutex > lock(queue.mutex);
+      queue.chunks.push_back({&job, c * grain, std::min(n, (c + 1) * grain)});
+   }
+   m_wakeup.notify_all();
+
+   // help out instead of idling until the job is done
+   Chunk chunk{};
+   while(job.remaining > 0 && _try_steal(m_queues.size(), chunk)) {
+      _run(chunk);
+   }
+   {
+      std::unique_lock< std::mutex > lock(job.mutex);
+      job.done.wait(lock, [&] { return job.remaining == 0; });
+   }
+   if(job.error) {
+      std::rethrow_exception(job.error);
+   }
+}
+
+void ThreadPool::_worker_loop(size_t idx)
+{
+   Chunk chunk{};
+   while(true) {
+      if(_try_pop(idx, chunk) || _try_steal(idx, chunk)) {
+         _run(chunk);
+         continue;
+      }
+      std::unique_lock< std::mutex > lock(m_mutex);
+      m_wakeup.wait(lock, [&] { return m_stop || m_queued > 0; });
+      if(m_stop && m_queued == 0) {
+         return;
+      }
+   }
+}
+
+bool ThreadPool::_try_pop(size_t idx, Chunk &chunk)
+{
+   auto &queue = *m_queues[idx];
+   std::lock_guard< std::mutex > lock(queue.mutex);
+   if(queue.chunks.empty()) {
+      return false;
+   }
+   chunk = queue.chunks.back();
+   queue.chunks.pop_back();
+   m_queued--;
+   return true;
+}
+
+bool ThreadPool::_try_steal(size_t idx, Chunk &chunk)
+{
+   // start with the neighbour so that thieves spread over the victims
+   for(size_t offset = 1; offset <= m_queues.size(); offset++) {
+      auto &queue = *m_queues[(idx + offset) % m_queues.size()];
+      std::lock_guard< std::mutex > lock(queue.mutex);
+      if(not queue.chunks.empty()) {
+         chunk = queue.chunks.front();
+         queue.chunks.pop_front();
+         m_queued--;
+         return true;
+      }
+   }
+   return false;
+}
+
+void ThreadPool::_run(const Chunk &chunk)
+{
+   Job &job = *chunk.job;
+   try {
+      (*job.task)(chunk.begin, chunk.end);
+   } catch(...) {
+      std::lock_guard< std::mutex > lock(job.mutex);
+      if(not job.error) {
+         job.error = std::current_exception();
+      }
+   }
+   // decrement under the lock, otherwise the caller could see the job done and destroy it while
+   // it is still being notified
+   std::lock_guard< std::mutex > lock(job.mutex);
+   if(--job.remaining == 0) {
+      job.done.notify_all();
+   }
+}
@@ -0,0 +1,110 @@
+
+#ifndef LORDECKENCODER_READ_CASES_H
+#define LORDECKENCODER_READ_CASES_H
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "deck_codec/card_id.h"
+#include "deck_codec/card_token.h"
+#include "deck_codec/region.h"
+#include "deck_codec/string_utils.h"
+
+inline std::map< std::string, std::vector<CardToken> > read_case_file(const std::filesystem::path& filepath)
+{
+   std::map< std::string, std::vector<CardToken> > out_data;
+   auto p = std::filesystem::current_path();
+
+   auto path = std::filesystem::path(filepath);
+   std::ifstream infile(path);
+   std::string delimiter = ":";
+   std::string line;
+   std::vector<CardToken> dcomp;
+   std::string dcode;
+   while(std::getline(infile, line)) {
+      string_utils::trim(line);
+      if(line.empty()) {
+         out_data.emplace(dcode, dcomp);
+         continue;
+      }
+      if(auto delim_pos = line.find(delimiter); delim_pos != std::string::npos) {
+         int count = std::stoi(line.substr(0, delim_pos));
+         std::string card_code = line.substr(delim_pos + 1, line.size());
+         dcomp.emplace_back(card_code, count);
+      } else {
+         dcode = line;
+         dcomp = std::vector<CardToken>{};
+      }
+   }
+   return out_data;
+}
+
+/// a code that fails to decode
+inline const std::string BAD_CODE = "I'm no card code!";
+
+/// the codes of the test cases tiled `repeats` times, every `bad_every`-th replaced by BAD_CODE
+inline std::vector< std::string > repeated_case_codes(size_t repeats, size_t bad_every = 0)
+{
+   auto decks = read_case_file("../test/test_cases.txt");
+   std::vector< std::string > codes;
+   for(size_t repeat = 0; repeat < repeats; repeat++) {
+      for(auto& [dcode, dcomp] : decks) {
+         codes.emplace_back(dcode);
+      }
+   }
+   for(size_t i = bad_every; bad_every > 0 && i <= codes.size(); i += bad_every) {
+      codes[i - 1] = BAD_CODE;
+   }
+   return codes;
+}
+
+/// a random card of any region from the sets 1 to max_set and the numbers 1 to max_number
+inline CardId random_card(std::mt19937& rng, uint32_t max_set = 6, uint32_t max_number = 120)
+{
+   std::uniform_int_distribution< uint32_t > set_dist(1, max_set);
+   std::uniform_int_distribution< size_t > region_dist(0, REGION_INFO.size() - 1);
+   std::uniform_int_distribution< uint32_t > number_dist(1, max_number);
+   uint32_t set = set_dist(rng);
+   auto region = static_cast< Region >(region_dist(rng));
+   return CardId(set, region, number_dist(rng));
+}
+
+/**
+ * A random deck of n_cards distinct cards drawn by random_card, 1 to max_count copies each, in
+ * the order drawn. There have to be at least n_cards cards to draw from.
+ */
+inline std::vector< CardIdCount > random_deck(
+   std::mt19937& rng,
+   size_t n_cards,
+   size_t max_count,
+   uint32_t max_set = 6,
+   uint32_t max_number = 120)
+{
+   std::uniform_int_distribution< size_t > count_dist(1, max_count);
+   std::vector< CardIdCount > deck;
+   while(deck.size() < n_cards) {
+      CardId id = random_card(rng, max_set, max_number);
+      if(std::none_of(deck.begin(), deck.end(), [&](const auto& c) { return c.first == id; })) {
+         deck.emplace_back(id, count_dist(rng));
+      }
+   }
+   return deck;
+}
+
+inline std::string to_lower(std::string str)
+{
+   for(auto& c : str) {
+      c = static_cast< char >(std::tolower(static_cast< unsigned char >(c)));
+   }
+   return str;
+}
+
+#endif  // LORDECKENCODER_READ_CASES_H
@@ -1,3 +1,6 @@
+#include <cctype>
+#include <random>
+
 #include "deck_codec/base32.h"
 
 #include "gtest/gtest.h"
@@ -24,4 +27,101 @@ TEST(base32_unittests, base32_basic)
       auto decoded = base32::decode(origs_encoded[i]);
       EXPECT_EQ(decoded, origs[i]);
    }
-}
\ No newline at end of file
+}
+
+TEST(base32_unittests, base32_padding)
+{
+   EXPECT_EQ(base32::encode("input", true), "NFXHA5LU");
+   EXPECT_EQ(base32::encode("f", true), "MY======");
+   EXPECT_EQ(base32::encoded_size(1, true), 8);
+   EXPECT_EQ(base32::encoded_size(6), 10);
+
+   std::array< char, 10 > buffer{};
+   EXPECT_EQ(base32::encode_to("foobar", buffer.data(), buffer.size()), 10);
+   EXPECT_EQ(std::string(buffer.data(), buffer.size()), "MZXW6YTBOI");
+   EXPECT_THROW(base32::encode_to("foobar", buffer.data(), 9), std::length_error);
+}
+TEST(base32_unittests, lenient_and_strict_decoding)
+{
+   EXPECT_EQ(base32::decode("nfxha5lu"), "input");
+   EXPECT_EQ(base32::decode(" NFXH-a5LU\n"), "input");
+   EXPECT_EQ(base32::decode("MY======"), "f");
+   EXPECT_EQ(base32::decode("MZXW6YTBOI======"), "foobar");
+   EXPECT_THROW(base32::decode("MY==A==="), std::invalid_argument);
+   EXPECT_THROW(base32::decode("MY=-"), std::invalid_argument);
+   EXPECT_THROW(base32::decode("NFX HA5LU"), std::invalid_argument);
+   EXPECT_THROW(base32::decode("NFXHA5L1"), std::invalid_argument);
+
+   // "MZ" carries non-zero bits after the first byte and "MYA" holds one character too many
+   EXPECT_EQ(base32::decode("MZ"), "f");
+   EXPECT_EQ(base32::decode("MYA"), "f");
+   EXPECT_EQ(base32::decode("MY======", true), "f");
+   EXPECT_THROW(base32::decode("MZ", true), std::invalid_argument);
+   EXPECT_THROW(base32::decode("MYA", true), std::invalid_argument);
+}
+
+TEST(base32_unittests, kernels_agree)
+{
+   std::mt19937 rng(7);
+   std::uniform_int_distribution< int > byte_dist(0, 255);
+   const std::string alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+
+   auto decode_with = [](base32::Kernel kernel, const std::string& code) {
+      base32::use_kernel(kernel);
+      try {
+         return base32::decode(code);
+      } catch(std::invalid_argument& e) {
+         return std::string("error: ") + e.what();
+      }
+   };
+   for(size_t len = 0; len < 200; len++) {
+      std::string code;
+      for(size_t i = 0; i < len; i++) {
+         code.push_back(alphabet[static_cast< size_t >(byte_dist(rng)) % alphabet.size()]);
+      }
+      std::string with_bad_char = code;
+      if(len > 0) {
+         with_bad_char[static_cast< size_t >(byte_dist(rng)) % len] = '1';
+      }
+      std::string mixed_case = code;
+      for(auto& c : mixed_case) {
+         if(byte_dist(rng) % 2 == 0) {
+            c = static_cast< char >(std::tolower(static_cast< unsigned char >(c)));
+         }
+      }
+      for(const auto& input : {code, with_bad_char, mixed_case}) {
+         auto expected = decode_with(base32::Kernel::SCALAR, input);
+         EXPECT_EQ(decode_with(base32::Kernel::SSE41, input), expected);
+         EXPECT_EQ(decode_with(base32::Kernel::AVX2, input), expected);
+      }
+   }
+   base32::use_kernel(base32::best_kernel());
+}
+
+TEST(base32_unittests, encode_kernels_agree)
+{
+   std::mt19937 rng(11);
+   std::uniform_int_distribution< int > byte_dist(0, 255);
+
+   auto encode_with = [](base32::Kernel kernel, const std::string& text, bool pad) {
+      base32::use_kernel(kernel);
+      std::string via_iterator;
+      base32::encode_to(text, std::back_inserter(via_iterator), pad);
+      EXPECT_EQ(base32::encode(text, pad), via_iterator);
+      return via_iterator;
+   };
+   for(size_t len = 0; len < 300; len++) {
+      std::string text;
+      for(size_t i = 0; i < len; i++) {
+         text.push_back(static_cast< char >(byte_dist(rng)));
+      }
+      for(bool pad : {false, true}) {
+         auto expected = encode_with(base32::Kernel::SCALAR, text, pad);
+         EXPECT_EQ(encode_with(base32::Kernel::SSE41, text, pad), expected);
+         EXPECT_EQ(encode_with(base32::Kernel::AVX2, text, pad), expected);
+         base32::use_kernel(base32::best_kernel());
+         EXPECT_EQ(base32::decode(expected.substr(0, base32::encoded_size(len))), text);
+      }
+   }
+   base32::use_kernel(base32::best_kernel());
+}
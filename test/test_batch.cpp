@@ -0,0 +1,140 @@
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "deck_codec/codec.h"
+#include "deck_codec/deck_batch.h"
+#include "deck_codec/thread_pool.h"
+#include "gtest/gtest.h"
+#include "read_cases.h"
+
+TEST(thread_pool, covers_every_index_once)
+{
+   ThreadPool pool(4);
+   std::vector< std::atomic< int > > hits(10000);
+   pool.parallel_for(hits.size(), 7, [&](size_t begin, size_t end) {
+      for(size_t i = begin; i < end; i++) {
+         hits[i]++;
+      }
+   });
+   for(const auto& hit : hits) {
+      EXPECT_EQ(hit, 1);
+   }
+}
+
+TEST(thread_pool, nested_loops_and_errors)
+{
+   ThreadPool pool(2);
+   std::atomic< size_t > total{0};
+   pool.parallel_for(8, 1, [&](size_t, size_t) {
+      pool.parallel_for(100, 10, [&](size_t begin, size_t end) { total += end - begin; });
+   });
+   EXPECT_EQ(total, 800);
+
+   EXPECT_THROW(
+      pool.parallel_for(
+         100, 1, [](size_t begin, size_t) {
+            if(begin == 42) {
+               throw std::runtime_error("chunk failed");
+            }
+         }),
+      std::runtime_error);
+}
+
+TEST(batch, decode_and_encode_in_input_order)
+{
+   auto decks = read_case_file("../test/test_cases.txt");
+   auto codes = repeated_case_codes(50, 97);
+   std::vector< std::vector< CardToken > > comps;
+   for(const auto& code : codes) {
+      comps.push_back(code == BAD_CODE ? std::vector< CardToken >() : decks.at(code));
+   }
+
+   ThreadPool pool(4);
+   auto decoded = DeckCodec::decode_batch< CardToken >(codes, pool);
+   ASSERT_EQ(decoded.size(), codes.size());
+   for(size_t i = 0; i < codes.size(); i++) {
+      if(codes[i] == BAD_CODE) {
+         EXPECT_FALSE(decoded[i].ok());
+         EXPECT_TRUE(decoded[i].value.empty());
+         continue;
+      }
+      ASSERT_TRUE(decoded[i].ok());
+      EXPECT_TRUE(container_eq(decoded[i].value, comps[i]));
+   }
+
+   comps[7] = {CardToken{"01XX002", 1}};
+   auto encoded = DeckCodec::encode_batch(comps, pool);
+   for(size_t i = 0; i < comps.size(); i++) {
+      if(codes[i] == BAD_CODE) {
+         continue;
+      }
+      EXPECT_EQ(encoded[i].ok(), i != 7);
+      if(i != 7) {
+         EXPECT_EQ(encoded[i].value, codes[i]);
+      }
+   }
+}
+
+TEST(batch, decode_into_columns_and_encode_slices)
+{
+   auto codes = repeated_case_codes(30, 97);
+
+   ThreadPool pool(4);
+   DeckBatch batch;
+   batch.push_back(DeckCodec::decode< CardIdCount >(codes[0]));
+   DeckCodec::decode_batch_into(codes, batch, pool);
+   ASSERT_EQ(batch.size(), codes.size() + 1);
+   std::vector< uint64_t > failed;
+   for(size_t i = 0; i < codes.size(); i++) {
+      if(codes[i] == BAD_CODE) {
+         failed.push_back(i + 1);
+         EXPECT_TRUE(batch[i + 1].empty());
+      }
+   }
+   ASSERT_FALSE(failed.empty());
+   EXPECT_EQ(batch.failed, failed);
+   EXPECT_EQ(batch.card_ids.size(), batch.counts.size());
+
+   EXPECT_EQ(DeckCodec::encode(batch[0]), codes[0]);
+   for(size_t i = 0; i < codes.size(); i++) {
+      if(codes[i] == BAD_CODE) {
+         continue;
+      }
+      DeckSlice deck = batch[i + 1];
+      EXPECT_TRUE(container_eq(
+         std::vector< CardIdCount >(deck.begin(), deck.end()),
+         DeckCodec::decode< CardIdCount >(codes[i])));
+      EXPECT_EQ(DeckCodec::encode(deck), codes[i]);
+   }
+
+   // the batch is a container of decks itself
+   auto encoded = DeckCodec::encode_batch(batch, pool);
+   ASSERT_EQ(encoded.size(), batch.size());
+   EXPECT_EQ(encoded[1].value, codes[0]);
+   EXPECT_EQ(encoded[codes.size()].value, codes.back());
+
+   batch.clear();
+   DeckCodec::decode_batch_into(std::vector< std::string >(), batch, pool);
+   EXPECT_TRUE(batch.empty());
+   EXPECT_EQ(batch.n_cards(), 0);
+}
+
+TEST(batch, diff_one_deck_against_many)
+{
+   auto codes = repeated_case_codes(20, 97);
+
+   ThreadPool pool(4);
+   auto diffs = DeckCodec::diff_batch(codes[0], codes, pool);
+   ASSERT_EQ(diffs.size(), codes.size());
+   for(size_t i = 0; i < codes.size(); i++) {
+      if(codes[i] == BAD_CODE) {
+         EXPECT_FALSE(diffs[i].ok());
+         EXPECT_TRUE(diffs[i].value.empty());
+         continue;
+      }
+      ASSERT_TRUE(diffs[i].ok());
+      EXPECT_EQ(diffs[i].value, DeckCodec::diff(codes[0], codes[i]));
+   }
+   EXPECT_THROW(DeckCodec::diff_batch(BAD_CODE, codes, pool), std::invalid_argument);
+}
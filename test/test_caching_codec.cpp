@@ -0,0 +1,111 @@
+#include <string>
+#include <vector>
+
+#include "deck_codec/caching_codec.h"
+#include "deck_codec/codec.h"
+#include "deck_codec/thread_pool.h"
+#include "gtest/gtest.h"
+#include "read_cases.h"
+
+TEST(caching_codec, hits_and_spellings_share_entries)
+{
+   auto decks = read_case_file("../test/test_cases.txt");
+   CachingDeckCodec cache(1024, 4);
+   for(auto& [dcode, dcomp] : decks) {
+      auto deck = cache.get(dcode);
+      EXPECT_TRUE(container_eq(
+         std::vector< CardIdCount >(deck->begin(), deck->end()),
+         DeckCodec::decode< CardIdCount >(dcode)));
+      EXPECT_TRUE(container_eq(cache.decode< CardToken >(dcode), dcomp));
+      EXPECT_EQ(DeckCodec::encode(*deck), dcode);
+
+      std::string lower = to_lower(dcode);
+      std::string spelled = " " + lower.substr(0, 4) + "-" + lower.substr(4) + "===\n";
+      EXPECT_EQ(cache.get(spelled), deck);
+   }
+   auto stats = cache.stats();
+   EXPECT_EQ(stats.misses, decks.size());
+   EXPECT_EQ(stats.hits, 2 * decks.size());
+   EXPECT_EQ(stats.evictions, 0);
+   EXPECT_EQ(stats.size, decks.size());
+
+   // broken codes throw and are not cached, padding within a code stays illegal
+   EXPECT_THROW(cache.get("I'm no card code!"), std::invalid_argument);
+   EXPECT_THROW(cache.get(decks.begin()->first.substr(0, 8) + "=" + "AAAA"), std::invalid_argument);
+   EXPECT_EQ(cache.stats().size, decks.size());
+
+   cache.clear();
+   EXPECT_EQ(cache.stats().size, 0);
+   cache.get(decks.begin()->first);
+   EXPECT_EQ(cache.stats().misses, decks.size() + 3);
+}
+
+TEST(caching_codec, clock_eviction_keeps_referenced_entries)
+{
+   auto decks = read_case_file("../test/test_cases.txt");
+   std::vector< std::string > codes;
+   for(auto& [dcode, dcomp] : decks) {
+      codes.push_back(dcode);
+   }
+   ASSERT_GE(codes.size(), 6);
+
+   // a single shard of 4 slots
+   CachingDeckCodec cache(4, 1);
+   for(size_t i = 0; i < 4; i++) {
+      cache.get(codes[i]);
+   }
+   // the hit marks codes[0], so that the hand passes it and evicts codes[1] instead
+   auto held = cache.get(codes[0]);
+   cache.get(codes[4]);
+   auto stats = cache.stats();
+   EXPECT_EQ(stats.evictions, 1);
+   EXPECT_EQ(stats.size, 4);
+
+   cache.get(codes[0]);
+   EXPECT_EQ(cache.stats().hits, stats.hits + 1);
+   cache.get(codes[1]);
+   EXPECT_EQ(cache.stats().misses, stats.misses + 1);
+
+   // evicted decks stay valid for their holders
+   for(size_t i = 0; i < codes.size(); i++) {
+      cache.get(codes[i]);
+   }
+   EXPECT_EQ(cache.stats().size, 4);
+   EXPECT_EQ(DeckCodec::encode(*held), codes[0]);
+}
+
+TEST(caching_codec, concurrent_lookups)
+{
+   auto decks = read_case_file("../test/test_cases.txt");
+   std::vector< std::string > codes;
+   for(auto& [dcode, dcomp] : decks) {
+      codes.push_back(dcode);
+   }
+   // fewer slots than codes, so that lookups and evictions interleave
+   CachingDeckCodec cache(codes.size() / 2, 2);
+   ThreadPool pool(4);
+   pool.parallel_for(20000, 16, [&](size_t begin, size_t end) {
+      for(size_t i = begin; i < end; i++) {
+         const std::string& code = codes[(i * 7) % codes.size()];
+         EXPECT_EQ(DeckCodec::encode(*cache.get(code)), code);
+      }
+   });
+   auto stats = cache.stats();
+   EXPECT_EQ(stats.hits + stats.misses, 20000);
+   EXPECT_LE(stats.size, codes.size() / 2);
+}
+
+TEST(caching_codec, capacity_bounds_all_shards)
+{
+   auto decks = read_case_file("../test/test_cases.txt");
+   ASSERT_GT(decks.size(), 10);
+   // more shards than slots
+   CachingDeckCodec cache(10, 16);
+   for(auto& [dcode, dcomp] : decks) {
+      cache.get(dcode);
+   }
+   auto stats = cache.stats();
+   EXPECT_LE(stats.size, 10);
+   EXPECT_EQ(stats.misses, decks.size());
+   EXPECT_EQ(stats.evictions, decks.size() - stats.size);
+}
@@ -4,40 +4,15 @@
 #include <string>
 #include <algorithm>
 #include <filesystem>
+#include <functional>
+#include <iterator>
+#include <random>
 
 #include "deck_codec/base32.h"
 #include "deck_codec/codec.h"
 #include "deck_codec/string_utils.h"
 #include "gtest/gtest.h"
-
-std::map< std::string, std::vector<CardToken> > read_case_file(const std::filesystem::path& filepath)
-{
-   std::map< std::string, std::vector<CardToken> > out_data;
-   auto p = std::filesystem::current_path();
-
-   auto path = std::filesystem::path(filepath);
-   std::ifstream infile(path);
-   std::string delimiter = ":";
-   std::string line;
-   std::vector<CardToken> dcomp;
-   std::string dcode;
-   while(std::getline(infile, line)) {
-      string_utils::trim(line);
-      if(line.empty()) {
-         out_data.emplace(dcode, dcomp);
-         continue;
-      }
-      if(auto delim_pos = line.find(delimiter); delim_pos != std::string::npos) {
-         int count = std::stoi(line.substr(0, delim_pos));
-         std::string card_code = line.substr(delim_pos + 1, line.size());
-         dcomp.emplace_back(card_code, count);
-      } else {
-         dcode = line;
-         dcomp = std::vector<CardToken>{};
-      }
-   }
-   return out_data;
-}
+#include "read_cases.h"
 
 TEST(load_cases, loading)
 {
@@ -142,6 +117,18 @@ TEST(order, order_should_not_matter2)
    EXPECT_EQ(encoded1, encoded2);
 }
 
+TEST(order, shuffled_cases_keep_their_codes)
+{
+   std::mt19937 rng(3);
+   auto decks = read_case_file("../test/test_cases.txt");
+   for(auto& [dcode, dcomp] : decks) {
+      for(int round = 0; round < 4; round++) {
+         std::shuffle(dcomp.begin(), dcomp.end(), rng);
+         EXPECT_EQ(DeckCodec::encode(dcomp), dcode);
+      }
+   }
+}
+
 TEST(specific_regions, bilgewater)
 {
    std::vector<CardToken> deck = std::vector< CardToken >{
@@ -172,6 +159,47 @@ TEST(specific_regions, targon)
    EXPECT_TRUE(container_eq(decoded, deck));
 }
 
+TEST(specific_regions, bandle_city_and_runeterra)
+{
+   std::vector<CardToken> deck = std::vector< CardToken >{
+      {"01DE002", 3}, {"04BC001", 3}, {"04BC011", 2}, {"05BC056", 1}};
+   std::string encoded = DeckCodec::encode(deck);
+   // the format byte carries the version of the newest region in the deck
+   EXPECT_EQ(base32::decode(encoded)[0], 0x14);
+   EXPECT_TRUE(container_eq(DeckCodec::decode<CardToken>(encoded), deck));
+
+   deck.emplace_back("06RU002", 1);
+   encoded = DeckCodec::encode(deck);
+   EXPECT_EQ(base32::decode(encoded)[0], 0x15);
+   EXPECT_TRUE(container_eq(DeckCodec::decode<CardToken>(encoded), deck));
+
+   std::vector< CardIdCount > ids;
+   for(const auto& card : deck) {
+      ids.emplace_back(DeckCodec::parse_card_id(card.code()), card.count());
+   }
+   InlineDeck< 8 > inline_deck;
+   for(const auto& [id, count] : ids) {
+      inline_deck.push_back(id, count);
+   }
+   EXPECT_EQ(DeckCodec::encode_ct(inline_deck).view(), encoded);
+}
+
+TEST(specific_regions, registry_lookups)
+{
+   for(size_t value = 0; value < REGION_INFO.size(); value++) {
+      Region region{};
+      ASSERT_TRUE(region_from_initials(REGION_INFO[value].initials, region));
+      EXPECT_EQ(static_cast< size_t >(region), value);
+      EXPECT_EQ(REGION_BY_ID[REGION_INFO[value].id], value);
+   }
+   Region region{};
+   EXPECT_FALSE(region_from_initials("XX", region));
+   EXPECT_FALSE(region_from_initials("de", region));
+   EXPECT_FALSE(region_from_initials("D", region));
+   EXPECT_EQ(DeckCodec::card_code(CardId(6, Region::RUNETERRA, 2)), "06RU002");
+   EXPECT_THROW(DeckCodec::parse_card_id("01XX001"), std::invalid_argument);
+}
+
 TEST(invalids, bad_version)
 {
    // make sure that a deck with an invalid version fails
@@ -211,4 +239,359 @@ TEST(invalids, garbage_decoding)
    EXPECT_THROW(DeckCodec::decode<CardToken>(bad_encoding32), std::invalid_argument);
    std::string bad_encoding_empty = "";
    EXPECT_THROW(DeckCodec::decode<CardToken>(bad_encoding_empty), std::invalid_argument);
-}
\ No newline at end of file
+}
+TEST(card_id, packing)
+{
+   CardId id = DeckCodec::parse_card_id("03MT010");
+   EXPECT_EQ(id.set(), 3);
+   EXPECT_EQ(id.region(), Region::TARGON);
+   EXPECT_EQ(id.number(), 10);
+   EXPECT_EQ(id.group(), CardId(3, Region::TARGON, 999).group());
+   EXPECT_EQ(DeckCodec::card_code(id), "03MT010");
+   EXPECT_THROW(DeckCodec::parse_card_id("03XX010"), std::invalid_argument);
+   EXPECT_THROW(DeckCodec::parse_card_id("0AMT010"), std::invalid_argument);
+}
+
+TEST(card_id, id_path_matches_token_path)
+{
+   auto decks = read_case_file("../test/test_cases.txt");
+   for(auto& [dcode, dcomp] : decks) {
+      std::vector< CardIdCount > ids;
+      for(const auto& card : dcomp) {
+         ids.emplace_back(DeckCodec::parse_card_id(card.code()), card.count());
+      }
+      EXPECT_EQ(DeckCodec::encode(ids), dcode);
+
+      auto decoded = DeckCodec::decode< CardIdCount >(dcode);
+      EXPECT_TRUE(container_eq(ids, decoded));
+   }
+}
+
+TEST(decode_each, nested_decoding)
+{
+   auto decks = read_case_file("../test/test_cases.txt");
+   std::vector< std::string > codes;
+   for(auto& [dcode, dcomp] : decks) {
+      codes.push_back(dcode);
+   }
+   // a deck whose byte stream exceeds the stack buffer of a decode
+   std::vector< CardIdCount > large;
+   for(uint32_t number = 1; number <= 600; number++) {
+      large.emplace_back(CardId(1, Region::DEMACIA, number), 1);
+   }
+   codes.push_back(DeckCodec::encode(large));
+
+   // every callback decodes another code on the same thread while the outer decode is running,
+   // both through the same callback type and through decode
+   using Callback = std::function< void(CardId, size_t) >;
+   for(size_t i = 0; i < codes.size(); i++) {
+      const std::string& inner = codes[(i + 1) % codes.size()];
+      auto inner_expected = DeckCodec::decode< CardIdCount >(inner);
+      std::vector< CardIdCount > outer;
+      std::vector< CardIdCount > nested;
+      Callback collect_nested = [&nested](CardId id, size_t count) {
+         nested.emplace_back(id, count);
+      };
+      Callback collect_outer = [&](CardId id, size_t count) {
+         outer.emplace_back(id, count);
+         nested.clear();
+         DeckCodec::decode_each(inner, collect_nested);
+         EXPECT_TRUE(container_eq(nested, inner_expected));
+         EXPECT_TRUE(container_eq(DeckCodec::decode< CardIdCount >(inner), inner_expected));
+      };
+      DeckCodec::decode_each(codes[i], collect_outer);
+      EXPECT_TRUE(container_eq(outer, DeckCodec::decode< CardIdCount >(codes[i])));
+   }
+}
+
+TEST(varint, cursor_reading)
+{
+   std::string bytes;
+   for(uint64_t value : {0UL, 1UL, 127UL, 128UL, 300UL, 1UL << 40U}) {
+      auto vint = Varint::from_int(value);
+      bytes.insert(bytes.end(), vint.begin(), vint.end());
+   }
+   const char* cursor = bytes.data();
+   const char* end = bytes.data() + bytes.size();
+   for(uint64_t value : {0UL, 1UL, 127UL, 128UL, 300UL, 1UL << 40U}) {
+      EXPECT_EQ(Varint::read_varint(cursor, end), value);
+   }
+   EXPECT_EQ(cursor, end);
+
+   // a dangling continuation byte is no valid varint
+   std::string truncated(1, static_cast< char >(0x80));
+   cursor = truncated.data();
+   EXPECT_THROW(
+      Varint::read_varint(cursor, truncated.data() + truncated.size()), std::invalid_argument);
+}
+
+TEST(varint, bulk_writing_matches_single_varints)
+{
+   static_assert(Varint::from_int(300).size() == 2);
+   static_assert(Varint::from_int(300)[0] == 0xAC && Varint::from_int(300)[1] == 0x02);
+   static_assert(Varint::encoded_size(0) == 1 && Varint::encoded_size(127) == 1);
+   static_assert(Varint::encoded_size(128) == 2 && Varint::encoded_size(UINT64_MAX) == 10);
+
+   std::vector< uint64_t > values;
+   for(unsigned int shift = 0; shift < 64; shift++) {
+      values.push_back(1ULL << shift);
+      values.push_back((1ULL << shift) - 1);
+   }
+   values.push_back(UINT64_MAX);
+
+   std::string expected;
+   for(uint64_t value : values) {
+      auto vint = Varint::from_int(value);
+      EXPECT_EQ(vint.size(), Varint::encoded_size(value));
+      expected.insert(expected.end(), vint.begin(), vint.end());
+   }
+   std::string written(values.size() * Varint::MAX_BYTES, '\0');
+   char* end = Varint::write_varints(values.begin(), values.end(), written.data());
+   written.resize(static_cast< size_t >(end - written.data()));
+   EXPECT_EQ(written, expected);
+
+   std::string appended;
+   Varint::write_varints(values.begin(), values.end(), std::back_inserter(appended));
+   EXPECT_EQ(appended, expected);
+
+   const char* cursor = written.data();
+   for(uint64_t value : values) {
+      EXPECT_EQ(Varint::read_varint(cursor, written.data() + written.size()), value);
+   }
+   EXPECT_THROW((void)Varint::from_int(1).at(1), std::out_of_range);
+}
+
+TEST(encode_to, caller_buffer)
+{
+   auto decks = read_case_file("../test/test_cases.txt");
+   std::vector< char > buffer;
+   for(auto& [dcode, dcomp] : decks) {
+      buffer.resize(DeckCodec::max_encoded_size(dcomp));
+      size_t n_written = DeckCodec::encode_to(dcomp, buffer.data(), buffer.size());
+      EXPECT_EQ(std::string(buffer.data(), n_written), dcode);
+
+      std::string from_iterator;
+      DeckCodec::encode_to(dcomp, std::back_inserter(from_iterator));
+      EXPECT_EQ(from_iterator, dcode);
+
+      EXPECT_THROW(
+         DeckCodec::encode_to(dcomp, buffer.data(), dcode.size() - 1), std::length_error);
+   }
+}
+
+TEST(constexpr_codec, compile_time_decks)
+{
+   // the first deck of test_cases.txt, resolved entirely at compile time
+   constexpr auto deck = DeckCodec::decode_ct< 40 >(
+      "CMBAIAIFB4WDANQIAEAQGDAUDAQSIJZUAIAQCAIEAEAQKBIA");
+   static_assert(deck.size() == 14);
+   static_assert(deck.count(0) == 3 && deck.count(13) == 2);
+
+   constexpr auto code = DeckCodec::encode_ct(deck);
+   static_assert(code.view() == "CMBAIAIFB4WDANQIAEAQGDAUDAQSIJZUAIAQCAIEAEAQKBIA");
+
+   constexpr InlineDeck< 4 > limited{
+      {CardId(1, Region::DEMACIA, 2), 4},
+      {CardId(2, Region::BILGEWATER, 3), 2},
+      {CardId(2, Region::BILGEWATER, 10), 3},
+      {CardId(4, Region::SHURIMA, 47), 5}};
+   constexpr auto limited_code = DeckCodec::encode_ct(limited);
+   EXPECT_EQ(limited_code.view(), DeckCodec::encode(limited));
+   EXPECT_TRUE(container_eq(
+      DeckCodec::decode< CardIdCount >(limited_code.view()),
+      std::vector< CardIdCount >(limited.begin(), limited.end())));
+
+   // the same functions run at runtime, where malformed codes throw
+   auto decks = read_case_file("../test/test_cases.txt");
+   for(auto& [dcode, dcomp] : decks) {
+      auto inline_deck = DeckCodec::decode_ct< 40 >(dcode);
+      EXPECT_TRUE(container_eq(
+         DeckCodec::decode< CardIdCount >(dcode),
+         std::vector< CardIdCount >(inline_deck.begin(), inline_deck.end())));
+      EXPECT_EQ(DeckCodec::encode_ct(inline_deck).view(), dcode);
+   }
+   EXPECT_THROW(DeckCodec::decode_ct< 40 >("CMBAI1IFB4WDANQ"), std::invalid_argument);
+   EXPECT_THROW(DeckCodec::decode_ct< 2 >(decks.begin()->first), std::length_error);
+}
+
+TEST(canonicalize, variants_map_to_the_canonical_code)
+{
+   auto decks = read_case_file("../test/test_cases.txt");
+   for(auto& [dcode, dcomp] : decks) {
+      EXPECT_EQ(DeckCodec::canonicalize(dcode), dcode);
+
+      std::string lower = to_lower(dcode);
+      EXPECT_EQ(DeckCodec::canonicalize(lower), dcode);
+      std::string separated = dcode.substr(0, 4) + "-" + dcode.substr(4) + "====";
+      EXPECT_EQ(DeckCodec::canonicalize(separated), dcode);
+
+      // another encoder's layout: every card in a group of its own, in reverse order, and all
+      // counts written as 4+ entries
+      std::string singles(1, static_cast< char >(0x13));
+      std::string as_Nofs(1, static_cast< char >(0x13));
+      auto append = [](std::string& bytes, uint64_t value) {
+         std::array< char, Varint::MAX_BYTES > buffer;
+         bytes.append(buffer.data(), Varint::write_varint(value, buffer.data()));
+      };
+      auto ids = DeckCodec::decode< CardIdCount >(dcode);
+      for(size_t count = 3; count > 0; count--) {
+         size_t n_groups = 0;
+         for(const auto& card : ids) {
+            n_groups += card.second == count;
+         }
+         append(singles, n_groups);
+         append(as_Nofs, 0);
+         for(auto it = ids.rbegin(); it != ids.rend(); ++it) {
+            if(it->second == count) {
+               append(singles, 1);
+               append(singles, it->first.set());
+               append(singles, REGION_INFO[static_cast< size_t >(it->first.region())].id);
+               append(singles, it->first.number());
+            }
+         }
+      }
+      for(auto it = ids.rbegin(); it != ids.rend(); ++it) {
+         if(it->second > 3) {
+            append(singles, it->second);
+            append(singles, it->first.set());
+            append(singles, REGION_INFO[static_cast< size_t >(it->first.region())].id);
+            append(singles, it->first.number());
+         }
+         append(as_Nofs, it->second);
+         append(as_Nofs, it->first.set());
+         append(as_Nofs, REGION_INFO[static_cast< size_t >(it->first.region())].id);
+         append(as_Nofs, it->first.number());
+      }
+      EXPECT_EQ(DeckCodec::canonicalize(base32::encode(singles)), dcode);
+      EXPECT_EQ(DeckCodec::canonicalize(base32::encode(as_Nofs)), dcode);
+   }
+
+   EXPECT_THROW(DeckCodec::canonicalize(""), std::invalid_argument);
+   EXPECT_THROW(DeckCodec::canonicalize("CMBAI1IFB4WDANQ"), std::invalid_argument);
+}
+
+TEST(memory_resource, decode_and_encode_into_an_arena)
+{
+   auto decks = read_case_file("../test/test_cases.txt");
+   // warm up the per-thread buffers, which the arena does not serve
+   for(auto& [dcode, dcomp] : decks) {
+      DeckCodec::encode(DeckCodec::decode< CardToken >(dcode));
+   }
+
+   // the arena has no upstream, so any allocation beyond its buffer throws std::bad_alloc
+   std::array< std::byte, 1 << 16 > buffer;
+   for(auto& [dcode, dcomp] : decks) {
+      std::pmr::monotonic_buffer_resource arena(
+         buffer.data(), buffer.size(), std::pmr::null_memory_resource());
+      auto tokens = DeckCodec::decode< CardToken >(dcode, &arena);
+      EXPECT_TRUE(container_eq(std::vector< CardToken >(tokens.begin(), tokens.end()), dcomp));
+      auto ids = DeckCodec::decode< CardIdCount >(dcode, &arena);
+      EXPECT_EQ(ids.size(), dcomp.size());
+      EXPECT_EQ(ids.get_allocator().resource(), &arena);
+
+      std::pmr::string code = DeckCodec::encode(ids, &arena);
+      EXPECT_EQ(std::string_view(code), dcode);
+      EXPECT_EQ(code.get_allocator().resource(), &arena);
+      EXPECT_EQ(std::string_view(DeckCodec::encode(tokens, &arena)), dcode);
+   }
+}
+
+TEST(inline_deck, sorted_helpers_and_codec_support)
+{
+   static_assert(std::is_trivially_copyable_v< InlineDeck< 40 > >);
+   static_assert(sizeof(InlineDeck< 40 >) == 40 * 8 + sizeof(size_t));
+
+   constexpr auto built = [] {
+      InlineDeck< 4 > deck;
+      deck.insert_sorted(CardId(2, Region::BILGEWATER, 3), 1);
+      deck.insert_sorted(CardId(1, Region::DEMACIA, 2), 2);
+      deck.insert_sorted(CardId(2, Region::BILGEWATER, 3), 1);
+      deck.insert_sorted(CardId(1, Region::DEMACIA, 1), 3);
+      deck.remove_sorted(CardId(1, Region::DEMACIA, 2), 1);
+      return deck;
+   }();
+   static_assert(built.size() == 3);
+   static_assert(built.id(0) == CardId(1, Region::DEMACIA, 1) && built.count(0) == 3);
+   static_assert(built.find(CardId(2, Region::BILGEWATER, 3)) == 2 && built.count(2) == 2);
+   static_assert(built.find(CardId(2, Region::BILGEWATER, 4)) == 3);
+
+   InlineDeck< 4 > deck = built;
+   EXPECT_EQ(deck.remove_sorted(CardId(1, Region::DEMACIA, 1), 5), 3);
+   EXPECT_EQ(deck.remove_sorted(CardId(1, Region::DEMACIA, 1), 1), 0);
+   EXPECT_EQ(deck.size(), 2);
+   deck.insert_sorted(CardId(3, Region::IONIA, 1), 1);
+   deck.insert_sorted(CardId(3, Region::IONIA, 2), 1);
+   EXPECT_THROW(deck.insert_sorted(CardId(3, Region::IONIA, 3), 1), std::length_error);
+   EXPECT_NO_THROW(deck.insert_sorted(CardId(3, Region::IONIA, 2), 1));
+
+   auto decks = read_case_file("../test/test_cases.txt");
+   std::mt19937 rng(19);
+   for(auto& [dcode, dcomp] : decks) {
+      InlineDeck< 40 > inline_deck;
+      DeckCodec::decode(dcode, inline_deck);
+      EXPECT_TRUE(container_eq(
+         std::vector< CardIdCount >(inline_deck.begin(), inline_deck.end()),
+         DeckCodec::decode< CardIdCount >(dcode)));
+      EXPECT_EQ(DeckCodec::encode(inline_deck), dcode);
+
+      // a shuffled copy sorts back into the same deck
+      std::vector< CardIdCount > ids(inline_deck.begin(), inline_deck.end());
+      std::shuffle(ids.begin(), ids.end(), rng);
+      InlineDeck< 40 > sorted;
+      for(const auto& [id, count] : ids) {
+         sorted.push_back(id, count);
+      }
+      sorted.sort();
+      inline_deck.sort();
+      EXPECT_TRUE(std::equal(sorted.begin(), sorted.end(), inline_deck.begin()));
+      EXPECT_EQ(DeckCodec::encode(sorted), dcode);
+   }
+   InlineDeck< 2 > small;
+   EXPECT_THROW(DeckCodec::decode(decks.begin()->first, small), std::length_error);
+}
+
+TEST(diff, patches_between_all_cases)
+{
+   auto decks = read_case_file("../test/test_cases.txt");
+   std::vector< std::string > codes;
+   for(auto& [dcode, dcomp] : decks) {
+      codes.push_back(dcode);
+   }
+   for(const auto& from : codes) {
+      EXPECT_TRUE(DeckCodec::diff(from, from).empty());
+      for(const auto& to : codes) {
+         auto deltas = DeckCodec::diff(from, to);
+         EXPECT_TRUE(std::is_sorted(deltas.begin(), deltas.end()));
+         EXPECT_EQ(DeckCodec::apply_patch(from, deltas), to);
+
+         // the same deltas by the quadratic lookup of the decoded tokens
+         auto old_deck = DeckCodec::decode< CardToken >(from);
+         auto new_deck = DeckCodec::decode< CardToken >(to);
+         size_t n_changed = 0;
+         for(const auto& card : new_deck) {
+            auto it = std::find_if(old_deck.begin(), old_deck.end(), [&](const auto& c) {
+               return c.code() == card.code();
+            });
+            n_changed += it == old_deck.end() || it->count() != card.count();
+         }
+         for(const auto& card : old_deck) {
+            n_changed += std::none_of(new_deck.begin(), new_deck.end(), [&](const auto& c) {
+               return c.code() == card.code();
+            });
+         }
+         EXPECT_EQ(deltas.size(), n_changed);
+      }
+   }
+
+   // deltas in any order, repeated cards and cards listed twice in the code add up
+   CardId ezreal = DeckCodec::parse_card_id("01PZ036");
+   CardId teemo = DeckCodec::parse_card_id("01PZ008");
+   std::string doubled = DeckCodec::encode(std::vector< CardIdCount >{{teemo, 1}, {teemo, 2}});
+   std::string patched =
+      DeckCodec::apply_patch(doubled, {{teemo, -1}, {ezreal, 2}, {teemo, -1}, {ezreal, 1}});
+   EXPECT_EQ(patched, DeckCodec::encode(std::vector< CardIdCount >{{ezreal, 3}, {teemo, 1}}));
+   std::vector< CardDelta > expected{{teemo, -2}, {ezreal, 3}};
+   EXPECT_EQ(DeckCodec::diff(doubled, patched), expected);
+   EXPECT_THROW(DeckCodec::apply_patch(doubled, {{teemo, -4}}), std::invalid_argument);
+   EXPECT_THROW(DeckCodec::diff(doubled, "I'm no card code!"), std::invalid_argument);
+}
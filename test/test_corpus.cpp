@@ -0,0 +1,97 @@
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "deck_codec/codec.h"
+#include "deck_codec/corpus.h"
+#include "gtest/gtest.h"
+#include "read_cases.h"
+
+TEST(corpus, decodes_into_columns_and_maps_them_back)
+{
+   auto decks = read_case_file("../test/test_cases.txt");
+   // enough lines for several chunks, with blank lines, CRLF endings and broken codes in between
+   std::string text;
+   std::vector< std::string > codes;
+   for(int round = 0; round < 300; round++) {
+      for(const auto& [dcode, dcomp] : decks) {
+         text += dcode + (round % 2 == 0 ? "\n" : "\r\n");
+         codes.push_back(dcode);
+      }
+      text += "\n";
+      text += "NOT-A-CODE1\n";
+      codes.emplace_back("NOT-A-CODE1");
+   }
+   auto path = std::filesystem::temp_directory_path() / "deck_codec_corpus_test.txt";
+   std::FILE* file = std::fopen(path.string().c_str(), "wb");
+   ASSERT_NE(file, nullptr);
+   std::fwrite(text.data(), 1, text.size(), file);
+   std::fclose(file);
+
+   ThreadPool pool(4);
+   DeckBatch columns = CorpusDecoder::decode_file(path.string(), pool);
+   ASSERT_EQ(columns.size(), codes.size());
+   EXPECT_EQ(columns.failed.size(), 300);
+
+   size_t n_failed = 0;
+   for(size_t i = 0; i < codes.size(); i++) {
+      std::vector< CardIdCount > expected;
+      try {
+         expected = DeckCodec::decode< CardIdCount >(codes[i]);
+      } catch(std::invalid_argument&) {
+         ASSERT_LT(n_failed, columns.failed.size());
+         EXPECT_EQ(columns.failed[n_failed++], i);
+      }
+      ASSERT_EQ(columns.deck_offsets[i + 1] - columns.deck_offsets[i], expected.size());
+      for(size_t c = 0; c < expected.size(); c++) {
+         EXPECT_EQ(columns.card_ids[columns.deck_offsets[i] + c], expected[c].first.value());
+         EXPECT_EQ(columns.counts[columns.deck_offsets[i] + c], expected[c].second);
+      }
+   }
+
+   auto columns_path = std::filesystem::temp_directory_path() / "deck_codec_corpus_test.cols";
+   columns.write(columns_path.string());
+   MappedColumns mapped(columns_path.string());
+   ASSERT_EQ(mapped.size(), columns.size());
+   ASSERT_EQ(mapped.n_cards(), columns.card_ids.size());
+   ASSERT_EQ(mapped.n_failed(), columns.failed.size());
+   EXPECT_TRUE(std::equal(
+      columns.deck_offsets.begin(), columns.deck_offsets.end(), mapped.deck_offsets()));
+   EXPECT_TRUE(std::equal(columns.card_ids.begin(), columns.card_ids.end(), mapped.card_ids()));
+   EXPECT_TRUE(std::equal(columns.counts.begin(), columns.counts.end(), mapped.counts()));
+   EXPECT_TRUE(std::equal(columns.failed.begin(), columns.failed.end(), mapped.failed()));
+   EXPECT_EQ(DeckCodec::encode(mapped[0]), codes[0]);
+
+   EXPECT_THROW(MappedColumns(path.string()), std::runtime_error);
+
+   // a header whose column sizes overflow, offsets out of order and failed decks out of range
+   std::string bytes(std::filesystem::file_size(columns_path), '\0');
+   file = std::fopen(columns_path.string().c_str(), "rb");
+   ASSERT_NE(file, nullptr);
+   ASSERT_EQ(std::fread(bytes.data(), 1, bytes.size(), file), bytes.size());
+   std::fclose(file);
+   auto corrupted_path = std::filesystem::temp_directory_path() / "deck_codec_corpus_bad.cols";
+   auto expect_rejected = [&](size_t position, uint64_t value) {
+      std::string corrupted = bytes;
+      std::memcpy(corrupted.data() + position, &value, sizeof(value));
+      std::FILE* out = std::fopen(corrupted_path.string().c_str(), "wb");
+      ASSERT_NE(out, nullptr);
+      std::fwrite(corrupted.data(), 1, corrupted.size(), out);
+      std::fclose(out);
+      EXPECT_THROW(MappedColumns(corrupted_path.string()), std::runtime_error);
+   };
+   const size_t header = 8;
+   const size_t offsets = header + 3 * sizeof(uint64_t);
+   expect_rejected(header + 2 * sizeof(uint64_t), columns.failed.size() + (uint64_t(1) << 61U));
+   expect_rejected(offsets, 1);
+   expect_rejected(offsets + 2 * sizeof(uint64_t), columns.card_ids.size() + 1);
+   expect_rejected(bytes.size() - sizeof(uint64_t), columns.size());
+   expect_rejected(bytes.size() - sizeof(uint64_t), columns.failed[columns.failed.size() - 2]);
+   std::filesystem::remove(corrupted_path);
+   std::filesystem::remove(path);
+   std::filesystem::remove(columns_path);
+
+   EXPECT_EQ(CorpusDecoder::decode("", pool).size(), 0);
+}
@@ -0,0 +1,66 @@
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "deck_codec/codec.h"
+#include "deck_codec/deck_builder.h"
+#include "gtest/gtest.h"
+#include "read_cases.h"
+
+TEST(deck_builder, starts_from_codes_and_cards)
+{
+   auto decks = read_case_file("../test/test_cases.txt");
+   for(auto& [dcode, dcomp] : decks) {
+      DeckBuilder builder = DeckBuilder::from_code(dcode);
+      EXPECT_EQ(builder.code(), dcode);
+      EXPECT_EQ(builder.size(), dcomp.size());
+
+      DeckBuilder by_card;
+      for(const auto& card : dcomp) {
+         EXPECT_EQ(by_card.add(card.code(), card.count()), card.count());
+      }
+      EXPECT_EQ(by_card.code(), dcode);
+   }
+
+   DeckBuilder empty;
+   EXPECT_TRUE(empty.empty());
+   EXPECT_EQ(empty.code(), DeckCodec::encode(std::vector< CardIdCount >()));
+   EXPECT_THROW(DeckBuilder::from_code("I'm no card code!"), std::invalid_argument);
+   EXPECT_THROW(empty.add("01XX001"), std::invalid_argument);
+   EXPECT_THROW(empty.add(CardId::from_value(0x01FF0001)), std::invalid_argument);
+}
+
+TEST(deck_builder, random_edits_match_full_encoding)
+{
+   std::mt19937 rng(22);
+   std::uniform_int_distribution< size_t > count_dist(0, 5);
+   std::uniform_int_distribution< int > op_dist(0, 2);
+
+   DeckBuilder builder;
+   for(size_t edit = 0; edit < 3000; edit++) {
+      // few sets and numbers, so that groups grow, shrink and tie in size
+      CardId id = random_card(rng, 3, 12);
+      size_t before = builder.count(id);
+      switch(op_dist(rng)) {
+         case 0:
+            EXPECT_EQ(builder.add(id), before + 1);
+            break;
+         case 1:
+            EXPECT_EQ(builder.remove(id, 2), before - std::min(before, size_t(2)));
+            break;
+         default:
+            builder.set_count(id, count_dist(rng));
+      }
+      // read the code only now and then, so that several edits pile up between re-emits
+      if(edit % 3 == 0) {
+         EXPECT_EQ(builder.code(), DeckCodec::encode(builder.cards()));
+      }
+   }
+   EXPECT_EQ(builder.code(), DeckCodec::encode(builder.cards()));
+   EXPECT_FALSE(builder.empty());
+
+   builder.clear();
+   EXPECT_TRUE(builder.empty());
+   EXPECT_EQ(builder.code(), DeckCodec::encode(std::vector< CardIdCount >()));
+}
@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "deck_codec/codec.h"
+#include "deck_codec/deck_index.h"
+#include "gtest/gtest.h"
+#include "read_cases.h"
+
+namespace {
+
+using DeckPredicate = std::function< bool(const DeckSlice&) >;
+
+size_t count_of(const DeckSlice& deck, CardId id)
+{
+   size_t count = 0;
+   for(const auto& [card, n] : deck) {
+      count += card == id ? n : 0;
+   }
+   return count;
+}
+
+bool has_region(const DeckSlice& deck, Region region)
+{
+   for(const auto& [card, n] : deck) {
+      if(card.region() == region) {
+         return true;
+      }
+   }
+   return false;
+}
+
+/// the decks a linear scan finds, leaving out the failed ones
+DeckSet scan(const DeckBatch& batch, const DeckPredicate& matches)
+{
+   DeckSet decks(batch.size());
+   for(size_t i = 0; i < batch.size(); i++) {
+      if(not std::binary_search(batch.failed.begin(), batch.failed.end(), i) && matches(batch[i])) {
+         decks.insert(i);
+      }
+   }
+   return decks;
+}
+
+/// a card of few decks, whose postings stay arrays
+const CardId RARE_CARD(1, Region::RUNETERRA, 6);
+
+/// many small decks from few cards, so that postings span several containers in both forms
+DeckBatch synthetic_batch(size_t n_decks)
+{
+   std::mt19937 rng(24);
+   std::uniform_int_distribution< size_t > size_dist(0, 6);
+   DeckBatch batch;
+   for(size_t d = 0; d < n_decks; d++) {
+      if(d % 1000 == 999) {
+         batch.fail_deck();
+         continue;
+      }
+      auto deck = random_deck(rng, size_dist(rng), 4, 1, 4);
+      if(d % 50 == 0) {
+         deck.emplace_back(RARE_CARD, 1);
+      }
+      // a card listed twice, whose copies count together
+      if(d % 7 == 0 && not deck.empty()) {
+         deck.push_back(deck.front());
+      }
+      for(const auto& [id, count] : deck) {
+         batch.add_card(id, count);
+      }
+      batch.finish_deck();
+   }
+   return batch;
+}
+
+}  // namespace
+
+TEST(deck_index, queries_match_a_linear_scan)
+{
+   auto codes = repeated_case_codes(30, 21);
+   ThreadPool pool(4);
+   DeckBatch batch;
+   DeckCodec::decode_batch_into(codes, batch, pool);
+   DeckIndex index = DeckIndex::build(batch, pool);
+   ASSERT_EQ(index.size(), codes.size());
+
+   ASSERT_FALSE(batch.card_ids.empty());
+   CardId card = CardId::from_value(batch.card_ids[0]);
+   Region region = card.region();
+   std::vector< std::pair< DeckQuery, DeckPredicate > > queries = {
+      {DeckQuery::all(), [](const DeckSlice&) { return true; }},
+      {DeckQuery::card(card), [&](const DeckSlice& d) { return count_of(d, card) >= 1; }},
+      {DeckQuery::card(card, 2), [&](const DeckSlice& d) { return count_of(d, card) >= 2; }},
+      {DeckQuery::card(card, 1, 2),
+       [&](const DeckSlice& d) { return count_of(d, card) >= 1 && count_of(d, card) <= 2; }},
+      {DeckQuery::region(Region::TARGON),
+       [](const DeckSlice& d) { return has_region(d, Region::TARGON); }},
+      {DeckQuery::card(card, 3) & DeckQuery::region(Region::TARGON),
+       [&](const DeckSlice& d) { return count_of(d, card) >= 3 && has_region(d, Region::TARGON); }},
+      {DeckQuery::region(region) & ~DeckQuery::card(card),
+       [&](const DeckSlice& d) { return has_region(d, region) && count_of(d, card) == 0; }},
+      {~DeckQuery::region(region) | DeckQuery::region(Region::IONIA),
+       [&](const DeckSlice& d) {
+          return not has_region(d, region) || has_region(d, Region::IONIA);
+       }},
+      {~DeckQuery::region(region) & ~DeckQuery::region(Region::IONIA),
+       [&](const DeckSlice& d) {
+          return not has_region(d, region) && not has_region(d, Region::IONIA);
+       }},
+   };
+   for(const auto& [query, matches] : queries) {
+      DeckSet expected = scan(batch, matches);
+      EXPECT_EQ(index.query(query), expected);
+      EXPECT_EQ(index.count(query), expected.count());
+   }
+   auto n_bad = static_cast< size_t >(std::count(codes.begin(), codes.end(), BAD_CODE));
+   EXPECT_EQ(index.count(DeckQuery::all()), codes.size() - n_bad);
+   EXPECT_EQ(index.count(DeckQuery::card("01SI015", 2, 1)), 0);
+   EXPECT_THROW(DeckQuery::card("01XX015"), std::invalid_argument);
+   EXPECT_EQ(DeckIndex().count(DeckQuery::all()), 0);
+}
+
+TEST(deck_index, containers_of_large_corpora)
+{
+   // more than 2^16 decks, with postings above and below the bitmap threshold
+   DeckBatch batch = synthetic_batch(150000);
+   ThreadPool pool(4);
+   DeckIndex index = DeckIndex::build(batch, pool);
+
+   CardId common(1, Region::DEMACIA, 1);
+   CardId rare = RARE_CARD;
+   DeckQuery query =
+      (DeckQuery::card(common, 2) | DeckQuery::card(rare)) & ~DeckQuery::region(Region::IONIA);
+   DeckPredicate matches = [&](const DeckSlice& d) {
+      return (count_of(d, common) >= 2 || count_of(d, rare) >= 1)
+             && not has_region(d, Region::IONIA);
+   };
+   DeckSet expected = scan(batch, matches);
+   EXPECT_GT(expected.count(), 4096);
+   EXPECT_GT(scan(batch, [&](const DeckSlice& d) { return count_of(d, rare) > 0; }).count(), 0);
+   EXPECT_EQ(index.query(query), expected);
+
+   // the slices of one container range merge into the same index as a serial build
+   ThreadPool no_workers(0);
+   DeckIndex serial = DeckIndex::build(batch, no_workers);
+   EXPECT_EQ(serial.byte_size(), index.byte_size());
+   EXPECT_EQ(serial.query(query), expected);
+
+   auto decks = index.query(DeckQuery::card(rare)).decks();
+   ASSERT_FALSE(decks.empty());
+   EXPECT_TRUE(std::is_sorted(decks.begin(), decks.end()));
+   EXPECT_GT(count_of(batch[decks.back()], rare), 0);
+}
+
+TEST(deck_index, written_and_loaded)
+{
+   DeckBatch batch = synthetic_batch(70000);
+   ThreadPool pool(4);
+   DeckIndex index = DeckIndex::build(batch, pool);
+
+   auto path = std::filesystem::temp_directory_path() / "deck_codec_index_test.idx";
+   index.write(path.string());
+   EXPECT_EQ(std::filesystem::file_size(path), index.byte_size());
+   DeckIndex loaded = DeckIndex::load(path.string());
+   EXPECT_EQ(loaded.size(), index.size());
+   EXPECT_EQ(loaded.n_postings(), index.n_postings());
+   DeckQuery query = DeckQuery::card(CardId(1, Region::FRELJORD, 2), 2, 3)
+                     | (DeckQuery::region(Region::SHURIMA) & ~DeckQuery::region(Region::NOXUS));
+   EXPECT_EQ(loaded.query(query), index.query(query));
+
+   // the index of the mapped columns is the same
+   auto columns_path = std::filesystem::temp_directory_path() / "deck_codec_index_test.cols";
+   batch.write(columns_path.string());
+   DeckIndex from_columns = DeckIndex::build(MappedColumns(columns_path.string()), pool);
+   EXPECT_EQ(from_columns.query(query), index.query(query));
+
+   // columns listing a failed deck past the corpus are rejected before they reach the build
+   {
+      ASSERT_FALSE(batch.failed.empty());
+      std::FILE* file = std::fopen(columns_path.string().c_str(), "r+b");
+      ASSERT_NE(file, nullptr);
+      const uint64_t failed = batch.size() + 64;
+      std::fseek(file, -static_cast< long >(sizeof(failed)), SEEK_END);
+      std::fwrite(&failed, sizeof(failed), 1, file);
+      std::fclose(file);
+   }
+   EXPECT_THROW(DeckIndex::build(MappedColumns(columns_path.string()), pool), std::runtime_error);
+
+   // a key start past the container table
+   {
+      std::FILE* file = std::fopen(path.string().c_str(), "r+b");
+      ASSERT_NE(file, nullptr);
+      const uint64_t key_start = ~uint64_t(0);
+      std::fseek(file, static_cast< long >(32 + index.n_postings() * sizeof(uint64_t)), SEEK_SET);
+      std::fwrite(&key_start, sizeof(key_start), 1, file);
+      std::fclose(file);
+   }
+   EXPECT_THROW(DeckIndex::load(path.string()), std::runtime_error);
+
+   std::filesystem::resize_file(path, index.byte_size() - 8);
+   EXPECT_THROW(DeckIndex::load(path.string()), std::runtime_error);
+   EXPECT_THROW(DeckIndex::load(columns_path.string()), std::runtime_error);
+   std::filesystem::remove(path);
+   std::filesystem::remove(columns_path);
+}
@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "deck_codec/codec.h"
+#include "deck_codec/deck_stats.h"
+#include "gtest/gtest.h"
+#include "read_cases.h"
+
+namespace {
+
+void expect_same(const DeckStats& stats, const DeckStats& other)
+{
+   EXPECT_EQ(stats.n_decks(), other.n_decks());
+   EXPECT_EQ(stats.n_failed(), other.n_failed());
+   EXPECT_EQ(stats.n_pairs(), other.n_pairs());
+   auto cards = stats.cards();
+   auto other_cards = other.cards();
+   ASSERT_EQ(cards.size(), other_cards.size());
+   for(size_t c = 0; c < cards.size(); c++) {
+      EXPECT_EQ(cards[c].id, other_cards[c].id);
+      EXPECT_EQ(cards[c].n_decks, other_cards[c].n_decks);
+      EXPECT_EQ(cards[c].n_copies, other_cards[c].n_copies);
+   }
+   auto top = stats.top_co_occurring(5);
+   auto other_top = other.top_co_occurring(5);
+   ASSERT_EQ(top.size(), other_top.size());
+   for(size_t c = 0; c < top.size(); c++) {
+      EXPECT_EQ(top[c].first, other_top[c].first);
+      ASSERT_EQ(top[c].second.size(), other_top[c].second.size());
+      for(size_t i = 0; i < top[c].second.size(); i++) {
+         EXPECT_EQ(top[c].second[i].id, other_top[c].second[i].id);
+         EXPECT_EQ(top[c].second[i].n_decks, other_top[c].second[i].n_decks);
+      }
+   }
+   for(size_t r1 = 0; r1 < REGION_INFO.size(); r1++) {
+      for(size_t r2 = 0; r2 < REGION_INFO.size(); r2++) {
+         EXPECT_EQ(
+            stats.region_pair(static_cast< Region >(r1), static_cast< Region >(r2)),
+            other.region_pair(static_cast< Region >(r1), static_cast< Region >(r2)));
+      }
+   }
+}
+
+}  // namespace
+
+TEST(deck_stats, matches_a_naive_count)
+{
+   auto codes = repeated_case_codes(20, 21);
+   ThreadPool pool(4);
+   DeckStats stats;
+   stats.add_codes(codes, pool);
+
+   std::map< CardId, CardStats > cards;
+   std::map< std::pair< CardId, CardId >, uint64_t > pairs;
+   std::map< std::pair< Region, Region >, uint64_t > region_pairs;
+   size_t n_failed = 0;
+   for(const auto& code : codes) {
+      std::vector< CardIdCount > deck;
+      try {
+         DeckCodec::decode_each(code, [&deck](CardId id, size_t count) {
+            deck.emplace_back(id, count);
+         });
+      } catch(std::exception&) {
+         n_failed++;
+         continue;
+      }
+      std::vector< Region > regions;
+      for(const auto& [id, count] : deck) {
+         cards[id].id = id;
+         cards[id].n_decks++;
+         cards[id].n_copies += count;
+         for(const auto& [other, other_count] : deck) {
+            if(id < other) {
+               pairs[{id, other}]++;
+            }
+         }
+         regions.push_back(id.region());
+      }
+      std::sort(regions.begin(), regions.end());
+      regions.erase(std::unique(regions.begin(), regions.end()), regions.end());
+      for(size_t r1 = 0; r1 < regions.size(); r1++) {
+         for(size_t r2 = r1 + 1; r2 < regions.size(); r2++) {
+            region_pairs[{regions[r1], regions[r2]}]++;
+         }
+      }
+   }
+
+   EXPECT_EQ(stats.n_failed(), n_failed);
+   EXPECT_EQ(stats.n_decks(), codes.size() - n_failed);
+   EXPECT_EQ(stats.n_cards(), cards.size());
+   EXPECT_EQ(stats.n_pairs(), pairs.size());
+   for(const auto& [id, expected] : cards) {
+      CardStats card = stats.card(id);
+      EXPECT_EQ(card.n_decks, expected.n_decks);
+      EXPECT_EQ(card.n_copies, expected.n_copies);
+      EXPECT_DOUBLE_EQ(
+         stats.play_rate(id),
+         static_cast< double >(expected.n_decks) / static_cast< double >(stats.n_decks()));
+      EXPECT_EQ(stats.co_occurrences(id, id), expected.n_decks);
+   }
+   for(const auto& [ids, n_decks] : pairs) {
+      EXPECT_EQ(stats.co_occurrences(ids.first, ids.second), n_decks);
+      EXPECT_EQ(stats.co_occurrences(ids.second, ids.first), n_decks);
+   }
+
+   // the top co-occurring cards of every card against a full sort of its pairs
+   for(const auto& [id, top] : stats.top_co_occurring(3)) {
+      std::vector< CoOccurrence > expected;
+      for(const auto& [ids, n_decks] : pairs) {
+         if(ids.first == id || ids.second == id) {
+            expected.push_back({ids.first == id ? ids.second : ids.first, n_decks});
+         }
+      }
+      std::sort(expected.begin(), expected.end(), [](const auto& c1, const auto& c2) {
+         return c1.n_decks > c2.n_decks || (c1.n_decks == c2.n_decks && c1.id < c2.id);
+      });
+      expected.resize(std::min(expected.size(), size_t(3)));
+      ASSERT_EQ(top.size(), expected.size());
+      auto single = stats.top_co_occurring(id, 3);
+      ASSERT_EQ(single.size(), expected.size());
+      for(size_t i = 0; i < expected.size(); i++) {
+         EXPECT_EQ(top[i].id, expected[i].id);
+         EXPECT_EQ(top[i].n_decks, expected[i].n_decks);
+         EXPECT_EQ(single[i].id, expected[i].id);
+      }
+   }
+
+   auto pairs_by_count = stats.region_pairs();
+   ASSERT_FALSE(pairs_by_count.empty());
+   for(size_t i = 0; i < pairs_by_count.size(); i++) {
+      const auto& [first, second, n_decks] = pairs_by_count[i];
+      EXPECT_LT(first, second);
+      EXPECT_EQ(n_decks, region_pairs.at({first, second}));
+      EXPECT_EQ(stats.region_pair(second, first), n_decks);
+      if(i > 0) {
+         EXPECT_GE(pairs_by_count[i - 1].n_decks, n_decks);
+      }
+   }
+   EXPECT_EQ(pairs_by_count.size(), region_pairs.size());
+}
+
+TEST(deck_stats, batches_and_merges_agree)
+{
+   auto codes = repeated_case_codes(3, 21);
+   ThreadPool pool(4);
+   ThreadPool no_workers(0);
+   DeckStats by_code;
+   by_code.add_codes(codes, no_workers);
+
+   // the same codes in chunks of a stream
+   DeckStats streamed;
+   auto half = codes.begin() + static_cast< std::ptrdiff_t >(codes.size() / 2);
+   streamed.add_codes(std::vector< std::string >(codes.begin(), half), pool);
+   streamed.add_codes(std::vector< std::string >(half, codes.end()), pool);
+   expect_same(streamed, by_code);
+
+   DeckBatch batch;
+   DeckCodec::decode_batch_into(codes, batch, pool);
+   DeckStats by_deck;
+   by_deck.add_decks(batch, pool);
+   expect_same(by_deck, by_code);
+
+   auto columns_path = std::filesystem::temp_directory_path() / "deck_codec_stats_test.cols";
+   batch.write(columns_path.string());
+   DeckStats by_column;
+   by_column.add_decks(MappedColumns(columns_path.string()), pool);
+   expect_same(by_column, by_code);
+   // failed decks out of order are rejected before they reach the aggregation
+   {
+      ASSERT_GE(batch.failed.size(), 2);
+      std::FILE* file = std::fopen(columns_path.string().c_str(), "r+b");
+      ASSERT_NE(file, nullptr);
+      const uint64_t failed = batch.failed.front();
+      std::fseek(file, -static_cast< long >(sizeof(failed)), SEEK_END);
+      std::fwrite(&failed, sizeof(failed), 1, file);
+      std::fclose(file);
+   }
+   EXPECT_THROW(
+      by_column.add_decks(MappedColumns(columns_path.string()), pool), std::runtime_error);
+   std::filesystem::remove(columns_path);
+
+   DeckStats merged;
+   for(const auto& code : codes) {
+      DeckStats single;
+      single.add_code(code);
+      merged.merge(single);
+   }
+   expect_same(merged, by_code);
+}
+
+TEST(deck_stats, repeated_cards_and_empty_stats)
+{
+   DeckStats stats;
+   EXPECT_EQ(stats.play_rate(CardId(1, Region::IONIA, 1)), 0.0);
+   EXPECT_TRUE(stats.top_co_occurring(CardId(1, Region::IONIA, 1), 3).empty());
+   EXPECT_TRUE(stats.top_co_occurring(3).empty());
+   EXPECT_TRUE(stats.region_pairs().empty());
+
+   // a card listed twice counts once, with its copies summed
+   CardId card(1, Region::IONIA, 1);
+   CardId other(2, Region::NOXUS, 7);
+   stats.add_deck(std::vector< CardIdCount >{{card, 1}, {other, 2}, {card, 2}});
+   stats.add_deck(std::vector< CardIdCount >{{card, 3}});
+   EXPECT_EQ(stats.n_decks(), 2);
+   EXPECT_EQ(stats.card(card).n_decks, 2);
+   EXPECT_EQ(stats.card(card).n_copies, 6);
+   EXPECT_DOUBLE_EQ(stats.card(card).average_copies(), 3.0);
+   EXPECT_DOUBLE_EQ(stats.play_rate(other), 0.5);
+   EXPECT_EQ(stats.co_occurrences(card, other), 1);
+   EXPECT_EQ(stats.region_pair(Region::NOXUS, Region::IONIA), 1);
+   EXPECT_EQ(stats.region_pair(Region::IONIA, Region::IONIA), 2);
+   EXPECT_TRUE(stats.top_co_occurring(card, 0).empty());
+
+   stats.clear();
+   EXPECT_EQ(stats.n_decks(), 0);
+   EXPECT_EQ(stats.n_cards(), 0);
+}
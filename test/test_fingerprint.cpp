@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <random>
+#include <set>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "deck_codec/codec.h"
+#include "deck_codec/fingerprint.h"
+#include "gtest/gtest.h"
+#include "read_cases.h"
+
+namespace {
+
+Fingerprint fingerprint_of(const std::vector< CardIdCount >& deck)
+{
+   FingerprintBuilder builder;
+   for(const auto& [id, count] : deck) {
+      builder.add(id, count);
+   }
+   return builder.finish();
+}
+
+/// random decks in canonical (sorted) form, each followed by a few near neighbours of it
+std::vector< std::vector< CardIdCount > > synthetic_decks(size_t n_decks)
+{
+   std::mt19937 rng(15);
+   std::uniform_int_distribution< size_t > size_dist(1, 40);
+
+   std::vector< std::vector< CardIdCount > > decks;
+   while(decks.size() < n_decks) {
+      std::vector< CardIdCount > deck = random_deck(rng, size_dist(rng), 3);
+      decks.push_back(deck);
+      // the same deck with one count changed, one card dropped and two counts swapped
+      std::vector< CardIdCount > neighbour = deck;
+      neighbour[0].second += 1;
+      decks.push_back(neighbour);
+      if(deck.size() > 1) {
+         neighbour = deck;
+         neighbour.pop_back();
+         decks.push_back(neighbour);
+         neighbour = deck;
+         std::swap(neighbour[0].second, neighbour[1].second);
+         decks.push_back(neighbour);
+      }
+   }
+   for(auto& deck : decks) {
+      std::sort(deck.begin(), deck.end());
+   }
+   return decks;
+}
+
+}  // namespace
+
+TEST(fingerprint, independent_of_format_and_order)
+{
+   auto decks = read_case_file("../test/test_cases.txt");
+   std::mt19937 rng(42);
+   for(auto& [dcode, dcomp] : decks) {
+      auto ids = DeckCodec::decode< CardIdCount >(dcode);
+      Fingerprint expected = DeckCodec::fingerprint(dcode);
+      std::shuffle(ids.begin(), ids.end(), rng);
+      EXPECT_EQ(fingerprint_of(ids), expected);
+
+      std::string lower = to_lower(dcode);
+      EXPECT_EQ(DeckCodec::fingerprint(lower + "===="), expected);
+
+      // tokens in shuffled order encode to the same code and thereby to the same fingerprint
+      std::shuffle(dcomp.begin(), dcomp.end(), rng);
+      EXPECT_EQ(DeckCodec::fingerprint(DeckCodec::encode(dcomp)), expected);
+   }
+   EXPECT_THROW(DeckCodec::fingerprint("CMBAI1IFB4WDANQ"), std::invalid_argument);
+}
+
+TEST(fingerprint, no_collisions_on_cases_and_synthetic_decks)
+{
+   auto decks = synthetic_decks(50000);
+   for(auto& [dcode, dcomp] : read_case_file("../test/test_cases.txt")) {
+      auto ids = DeckCodec::decode< CardIdCount >(dcode);
+      std::sort(ids.begin(), ids.end());
+      decks.push_back(ids);
+   }
+   std::sort(decks.begin(), decks.end());
+   decks.erase(std::unique(decks.begin(), decks.end()), decks.end());
+
+   std::set< Fingerprint > fingerprints;
+   std::unordered_set< uint64_t > values;
+   for(const auto& deck : decks) {
+      Fingerprint fingerprint = fingerprint_of(deck);
+      EXPECT_TRUE(fingerprints.insert(fingerprint).second);
+      EXPECT_TRUE(values.insert(fingerprint.value()).second);
+   }
+   EXPECT_GT(decks.size(), 40000);
+}
+
+TEST(fingerprint, batch_matches_single_codes)
+{
+   auto codes = repeated_case_codes(20, 97);
+
+   ThreadPool pool(4);
+   auto fingerprints = DeckCodec::fingerprint_batch(codes, pool);
+   ASSERT_EQ(fingerprints.size(), codes.size());
+   for(size_t i = 0; i < codes.size(); i++) {
+      if(codes[i] == BAD_CODE) {
+         EXPECT_FALSE(fingerprints[i].ok());
+      } else {
+         ASSERT_TRUE(fingerprints[i].ok());
+         EXPECT_EQ(fingerprints[i].value, DeckCodec::fingerprint(codes[i]));
+      }
+   }
+}